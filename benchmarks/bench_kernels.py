@@ -0,0 +1,70 @@
+import argparse
+import glob
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+# --- Configuration ---
+# Path to your compiler binary (adjust if your build folder is different)
+COMPILER_BIN = "./build/picc"
+
+# The kernels live next to this script
+KERNEL_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "kernels")
+
+# An instruction or value of vector type in the printed IR, e.g. "<4 x i64>"
+VECTOR_TYPE = re.compile(r"<\d+ x i\d+>")
+
+
+def count_vector_lines(compiler, kernel, level):
+    """Compiles a kernel to IR and counts the lines that use vector types."""
+    result = subprocess.run([compiler, level, kernel], capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr)
+        sys.exit(1)
+    return sum(1 for line in result.stdout.splitlines() if VECTOR_TYPE.search(line))
+
+
+def run_time(compiler, kernel, level, tmp, runs):
+    """Builds a kernel into an executable and returns its best run time in ms and its exit status."""
+    executable = os.path.join(tmp, os.path.basename(kernel) + level)
+    result = subprocess.run([compiler, level, "-o", executable, kernel], capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr)
+        sys.exit(1)
+
+    best = None
+    status = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        status = subprocess.run([executable]).returncode
+        elapsed = (time.perf_counter() - start) * 1000
+        best = elapsed if best is None else min(best, elapsed)
+    return best, status
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compiles the loop kernels and shows whether they are vectorized.")
+    parser.add_argument("--compiler", default=COMPILER_BIN, help="picc binary to use")
+    parser.add_argument("--levels", default="-O0,-O1,-O2,-O3", help="comma-separated optimization levels")
+    parser.add_argument("--runs", type=int, default=3, help="runs per executable (the minimum is reported)")
+    parser.add_argument("kernels", nargs="*", help="kernel files (default: all of benchmarks/kernels)")
+    args = parser.parse_args()
+
+    kernels = args.kernels or sorted(glob.glob(os.path.join(KERNEL_DIR, "*.pi")))
+    levels = args.levels.split(",")
+
+    print(f"{'Kernel':<20} {'Level':<6} {'Vector IR lines':>16} {'Time (ms)':>12} {'Exit':>6}")
+    with tempfile.TemporaryDirectory() as tmp:
+        for kernel in kernels:
+            name = os.path.splitext(os.path.basename(kernel))[0]
+            for level in levels:
+                vector_lines = count_vector_lines(args.compiler, kernel, level)
+                elapsed, status = run_time(args.compiler, kernel, level, tmp, args.runs)
+                print(f"{name:<20} {level:<6} {vector_lines:>16} {elapsed:>12.1f} {status:>6}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,106 @@
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+# --- Configuration ---
+# Path to your compiler binary (adjust if your build folder is different)
+COMPILER_BIN = "./build/picc"
+
+# picc lexes on demand while parsing, so the lexer is measured through the front end row.
+# Matches a row of the performance summary printed by picc
+SCOPE_ROW = re.compile(r"^\s*{name}\s+\d+\s+([0-9.]+)\s")
+
+
+def generate_source(functions, statements):
+    """
+    Generates an identifier-heavy Pi program.
+    Every statement declares a long-named constant that refers to the previous one,
+    so the lexer mostly sees identifiers, keywords and type names. The value stays 1,
+    since constant expressions that overflow are compile errors.
+    """
+    lines = []
+    for f in range(functions):
+        lines.append(f"func generatedFunction{f}() -> int32 {{")
+        lines.append(f"    const someRatherLongIdentifier{f}x0: int32 = 1")
+        for s in range(1, statements):
+            prev = f"someRatherLongIdentifier{f}x{s - 1}"
+            lines.append(f"    const someRatherLongIdentifier{f}x{s}: int32 = {prev} * 2 - {prev} // keep it busy")
+        lines.append(f"    return someRatherLongIdentifier{f}x{statements - 1}")
+        lines.append("}")
+        lines.append("")
+    return "\n".join(lines)
+
+
+def generate_print_table(functions, statements):
+    """
+    Generates a comment- and string-heavy Pi program, similar to generated print tables.
+    """
+    lines = []
+    for f in range(functions):
+        lines.append(f"// ---------------------------------------------------------------------------")
+        lines.append(f"// Generated table {f}: every row is printed verbatim, do not edit by hand")
+        lines.append(f"// ---------------------------------------------------------------------------")
+        lines.append(f"func table{f}() -> void {{")
+        for s in range(statements):
+            row = " | ".join(f"cell {f}.{s}.{c}" for c in range(6))
+            lines.append(f"        print(\"{row}\")        // row {s} of table {f}")
+        lines.append("}")
+        lines.append("")
+    return "\n".join(lines)
+
+
+GENERATORS = {
+    "identifiers": generate_source,
+    "prints": generate_print_table,
+}
+
+
+def measure(compiler, source_path, scope):
+    """Runs the compiler once and returns the time of the given scope in ms."""
+    result = subprocess.run([compiler, source_path], capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr)
+        sys.exit(1)
+
+    pattern = re.compile(SCOPE_ROW.pattern.format(name=re.escape(scope)))
+    for line in result.stderr.splitlines():
+        match = pattern.match(line)
+        if match:
+            return float(match.group(1))
+
+    print(f"Scope '{scope}' not found in the performance summary")
+    sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measures the lexer on a generated input.")
+    parser.add_argument("--compiler", action="append", dest="compilers",
+                        help="picc binary to measure (may be given several times to compare builds)")
+    parser.add_argument("--shape", choices=sorted(GENERATORS), default="identifiers",
+                        help="kind of generated input")
+    parser.add_argument("--functions", type=int, default=2000, help="number of generated functions")
+    parser.add_argument("--statements", type=int, default=50, help="statements per function")
+    parser.add_argument("--runs", type=int, default=5, help="runs per compiler (the minimum is reported)")
+    parser.add_argument("--scope", default="Lexing + Parsing", help="performance summary row to report")
+    args = parser.parse_args()
+
+    compilers = args.compilers or [COMPILER_BIN]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        source_path = os.path.join(tmp, "bench.pi")
+        with open(source_path, "w") as f:
+            f.write(GENERATORS[args.shape](args.functions, args.statements))
+
+        size_mb = os.path.getsize(source_path) / (1024 * 1024)
+        print(f"Input: {args.functions} functions, {size_mb:.1f} MB")
+
+        for compiler in compilers:
+            best = min(measure(compiler, source_path, args.scope) for _ in range(args.runs))
+            print(f"{compiler}: {args.scope} {best:.3f} ms ({size_mb / (best / 1000):.1f} MB/s)")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,280 @@
+#ifndef AST_H
+#define AST_H
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+
+/// @brief Index of a node in an Ast
+using NodeId = uint32_t;
+
+/// @brief Marks an absent child (e.g. a return without value)
+constexpr NodeId kNoNode = UINT32_MAX;
+
+/// @brief Kind tag of an AST node; visitors switch on it
+enum class NodeKind : uint8_t {
+    Function,       ///< name, type (return type), op (exported), parameters and body list
+    Param,          ///< name, type (leads the body list of its function)
+    Print,          ///< name (the text to print)
+    Const,          ///< name, type (declared type), value
+    Var,            ///< name, type (declared type), value (the initial one; kNoNode for a zero-filled array)
+    Assign,         ///< name (a Var), type (its type; set by Sema), value
+    IndexAssign,    ///< name (array, slice or vector), op (bounds check), type (element type; set by Sema), left (index), right (value)
+    While,          ///< list: condition, then the statements of the body
+    For,            ///< name (loop variable), type (its type; set by Sema), list: range start, range end, then the body
+    Return,         ///< value (kNoNode if absent)
+    Number,         ///< number
+    Char,           ///< number (the character code)
+    Variable,       ///< name
+    BinaryOp,       ///< op, left, right
+    Compare,        ///< op, left, right (a loop condition; type is the type of the comparison, set by Sema)
+    Call,           ///< name (the callee), argument list
+    Index,          ///< name (array, slice or vector), op (bounds check), type (element type; set by Sema), left (index)
+    Slice,          ///< name (array or slice), op (bounds check), type (slice type; set by Sema), left (first index), right (end, excluded)
+    Length,         ///< name (array, slice or vector); type int64 (the length of an array or vector is folded into a Constant by Sema)
+    Reduce,         ///< op ('+', '*', '<' for min, '>' for max), type (the lane type; set by Sema), left (the vector)
+    ArrayLiteral,   ///< element list; type (the declared array or vector type; set by Sema)
+    Constant        ///< number (a folded expression or constant reference; set by Sema)
+};
+
+/**
+ * @brief One AST node.
+ *
+ * All kinds share one plain layout so nodes can live in a single flat array.
+ * Children are 32-bit indices into that array; text is a view into the
+ * source buffer and types are TypeTable ids, so a node owns no memory.
+ */
+struct AstNode {
+    NodeKind kind;
+    char op = 0;                    ///< BinaryOp: '+', '-', '*' or '/'; Compare: see compareOps; Function: 1 if exported; Reduce: see NodeKind;
+                                    ///< Index, IndexAssign and Slice: see boundsChecks (set by Sema); Number: 'u' above INT64_MAX
+    TypeId type = kNoType;          ///< Function return type; Param, Const, Var, Assign and For variable type; expression type (set by Sema)
+    uint32_t offset = 0;            ///< Source offset of the node's token (for diagnostics)
+    std::string_view name;          ///< Function, Const, Var, Assign, For and Variable name; indexed name; Print text
+    union {
+        int64_t number;             ///< Number value (its 64 bits), Char code, Constant value (bits of its type, sign-/zero-extended)
+        NodeId children[2];         ///< Accessed through left() / right()
+    };
+
+    AstNode(NodeKind kind, uint32_t offset) : kind(kind), offset(offset), children { kNoNode, kNoNode } {}
+
+    /// @brief BinaryOp and Compare left operand; Const, Var, Assign and Return value; index (Index, IndexAssign)
+    ///        or first index (Slice); Reduce operand; Function, Call, While, For and ArrayLiteral: first list entry
+    NodeId& left() { return children[0]; }
+    NodeId left() const { return children[0]; }
+
+    /// @brief BinaryOp and Compare right operand; IndexAssign value; Slice end;
+    ///        Function, Call, While, For and ArrayLiteral: number of list entries
+    NodeId& right() { return children[1]; }
+    NodeId right() const { return children[1]; }
+
+    /// @brief The value of a Const, Var, Assign or Return node
+    NodeId value() const { return children[0]; }
+
+    /// @brief Whether a Function is visible outside of its module (declared with 'export')
+    bool isExported() const { return op != 0; }
+};
+
+static_assert(sizeof(AstNode) <= 32, "AST nodes should stay small");
+
+/// @brief Compare ops: the first character of the operator, 'l' for <= and 'g' for >=
+namespace compareOps {
+    constexpr char Equal        = '=';
+    constexpr char NotEqual     = '!';
+    constexpr char Less         = '<';
+    constexpr char LessEqual    = 'l';
+    constexpr char Greater      = '>';
+    constexpr char GreaterEqual = 'g';
+}
+
+/**
+ * @brief Bounds checks of Index, IndexAssign and Slice nodes (decided by Sema).
+ *
+ * An access is checked at run time unless Sema proves it in range or the
+ * program is compiled with --no-bounds-checks. An access whose index is a
+ * for loop variable can have its check hoisted: the loop then runs in two
+ * versions, one without the check that is entered when the whole range of
+ * the loop is in bounds, and one with the check.
+ */
+namespace boundsChecks {
+    constexpr char Checked = 0;
+    constexpr char Elided  = 'e';   ///< Proven in range (or checks are disabled)
+    constexpr char Hoisted = 'h';   ///< Index is a for loop variable; checked once before the loop
+}
+
+/// @brief A contiguous run of node ids (e.g. the statements of a function body)
+struct NodeRange {
+    const NodeId* first;
+    const NodeId* last;
+
+    const NodeId* begin() const { return first; }
+    const NodeId* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+};
+
+/**
+ * @brief Flat storage for the AST of one source file.
+ *
+ * Nodes are appended to one vector and never freed individually, so the
+ * tree is torn down with a single deallocation. Variable-length children
+ * (function parameters and bodies, call arguments, loop bodies, array
+ * literals) are stored as ranges in a second vector.
+ */
+class Ast {
+public:
+
+    /// @brief Appends a node and returns its id
+    NodeId add(const AstNode& node) {
+        nodes.push_back(node);
+        return static_cast<NodeId>(nodes.size() - 1);
+    }
+
+    const AstNode& get(NodeId id) const { return nodes[id]; }
+    AstNode& get(NodeId id) { return nodes[id]; }
+
+    /// @brief Stores the Param nodes and statements of a function (in this order) and links them to the function node
+    void setBody(NodeId function, const std::vector<NodeId>& entries) { setList(function, entries); }
+
+    /// @brief The Param nodes of a function
+    NodeRange parameters(const AstNode& function) const {
+        NodeRange entries = list(function);
+        const NodeId* last = entries.first;
+        while (last != entries.last && nodes[*last].kind == NodeKind::Param) ++last;
+        return { entries.first, last };
+    }
+
+    /// @brief The statements of a function body
+    NodeRange body(const AstNode& function) const {
+        return { parameters(function).last, list(function).last };
+    }
+
+    /// @brief Stores the arguments of a call and links them to the call node
+    void setArguments(NodeId call, const std::vector<NodeId>& arguments) { setList(call, arguments); }
+
+    /// @brief The arguments of a call
+    NodeRange arguments(const AstNode& call) const { return list(call); }
+
+    /// @brief Stores the leading entries of a loop (While: condition; For: range start and end) and its statements
+    void setLoop(NodeId loop, const std::vector<NodeId>& entries) { setList(loop, entries); }
+
+    /// @brief The condition of a While
+    NodeId condition(const AstNode& loop) const { return list(loop).first[0]; }
+
+    /// @brief The first value of a For loop variable
+    NodeId rangeStart(const AstNode& loop) const { return list(loop).first[0]; }
+
+    /// @brief The bound of a For loop (excluded)
+    NodeId rangeEnd(const AstNode& loop) const { return list(loop).first[1]; }
+
+    /// @brief The statements of a While or For body
+    NodeRange loopBody(const AstNode& loop) const {
+        NodeRange entries = list(loop);
+        return { entries.first + (loop.kind == NodeKind::While ? 1 : 2), entries.last };
+    }
+
+    /// @brief Stores the elements of an array literal and links them to its node
+    void setElements(NodeId literal, const std::vector<NodeId>& elements) { setList(literal, elements); }
+
+    /// @brief The elements of an array literal
+    NodeRange elements(const AstNode& literal) const { return list(literal); }
+
+    /// @brief Records a parsed function (top-level declarations, in source order)
+    void addFunction(NodeId function) { functions.push_back(function); }
+
+    const std::vector<NodeId>& getFunctions() const { return functions; }
+
+    /// @brief Builds the lookup of findFunction() (once all functions are parsed)
+    void indexFunctions() {
+        functionIndex.clear();
+        for (NodeId function : functions) {
+            auto [entry, inserted] = functionIndex.emplace(nodes[function].name, function);
+            if (!inserted) entry->second = kNoNode;
+        }
+    }
+
+    /**
+     * @brief The function with the given name (see indexFunctions()).
+     *
+     * @return The Function node, kNoNode if the name is defined more than once, nothing if it is not defined.
+     */
+    std::optional<NodeId> findFunction(std::string_view name) const {
+        auto entry = functionIndex.find(name);
+        if (entry == functionIndex.end()) return std::nullopt;
+        return entry->second;
+    }
+
+    size_t size() const { return nodes.size(); }
+
+    /**
+     * @brief Moves the nodes, bodies and functions of another Ast to the end of this one.
+     *
+     * Child ids and body ranges are shifted by the current sizes, so appending
+     * the Asts of consecutive source slices yields the same ids as parsing
+     * the slices one after another into a single Ast.
+     */
+    void append(const Ast& other);
+
+private:
+    std::vector<AstNode> nodes;
+    std::vector<NodeId> lists;
+    std::vector<NodeId> functions;
+    std::unordered_map<std::string_view, NodeId> functionIndex;
+
+    void setList(NodeId id, const std::vector<NodeId>& entries) {
+        AstNode& node = nodes[id];
+        node.left() = static_cast<NodeId>(lists.size());
+        node.right() = static_cast<NodeId>(entries.size());
+        lists.insert(lists.end(), entries.begin(), entries.end());
+    }
+
+    NodeRange list(const AstNode& node) const {
+        const NodeId* first = lists.data() + node.left();
+        return { first, first + node.right() };
+    }
+};
+
+inline void Ast::append(const Ast& other) {
+    NodeId nodeBase = static_cast<NodeId>(nodes.size());
+    NodeId listBase = static_cast<NodeId>(lists.size());
+
+    nodes.reserve(nodes.size() + other.nodes.size());
+    for (AstNode node : other.nodes) {
+        switch (node.kind) {
+            case NodeKind::Function:
+            case NodeKind::Call:
+            case NodeKind::While:
+            case NodeKind::For:
+            case NodeKind::ArrayLiteral:
+                node.left() += listBase;
+                break;
+            case NodeKind::Const:
+            case NodeKind::Var:
+            case NodeKind::Assign:
+            case NodeKind::Return:
+            case NodeKind::Index:
+            case NodeKind::Reduce:
+                if (node.left() != kNoNode) node.left() += nodeBase;
+                break;
+            case NodeKind::BinaryOp:
+            case NodeKind::Compare:
+            case NodeKind::IndexAssign:
+            case NodeKind::Slice:
+                node.left() += nodeBase;
+                node.right() += nodeBase;
+                break;
+            default:
+                // Number, Char and Constant keep a value in the union, the rest no children
+                break;
+        }
+        nodes.push_back(node);
+    }
+
+    for (NodeId id : other.lists) lists.push_back(id + nodeBase);
+    for (NodeId id : other.functions) functions.push_back(id + nodeBase);
+}
+
+#endif
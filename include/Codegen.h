@@ -3,6 +3,10 @@
 
 #include <memory>
 #include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
@@ -10,7 +14,10 @@
 #include <llvm/IR/Verifier.h>
 #include <llvm/Support/raw_ostream.h>
 
-#include "Parser.h"
+#include "AST.h"
+#include "CompileCache.h"
+#include "Optimizer.h"
+#include "SourceManager.h"
 
 /**
  * @brief Class for generating the LLVM IR from an AST.
@@ -26,30 +33,101 @@ public:
      *
      * Initializes the LLVM context, the module and the IRBuilder.
      * Also initializes the native target and declares the external C function puts.
+     *
+     * @param sourceManager The source the AST was parsed from (used for diagnostics).
+     * @param ast The parsed program after semantic analysis.
      */
-    Codegen();
+    Codegen(const SourceManager& sourceManager, const Ast& ast);
+
+    /// @brief Initializes the native target of LLVM (once per process; e.g. ahead of time in the compile server)
+    static void initializeTargets();
 
     /**
      * @brief Generates the LLVM IR code for a given function.
      *
-     * Generates the corresponding LLVM function based on the transferred AST (FuncNode),
+     * Generates the corresponding LLVM function based on the Function node,
      * adds the function body (e.g. a print command) and verifies the function.
      *
-     * @param funcAST Pointer to the AST node of the function.
+     * @param function Id of the Function node.
+     */
+    void generateCode(NodeId function);
+
+    /**
+     * @brief Generates a list of functions, optionally on several threads.
+     *
+     * With jobs > 1 the functions are split into contiguous groups. Each group
+     * is generated by its own Codegen (own context and module) on a thread
+     * pool, serialized to bitcode and linked into this module in source order.
+     * The printed module is identical to a serial run. Afterwards the
+     * functions that are not exported get internal linkage.
+     *
+     * @param functions Function nodes in source order.
+     * @param jobs Number of worker threads (1 = serial).
+     */
+    void generateFunctions(const std::vector<NodeId>& functions, unsigned jobs);
+
+    /**
+     * @brief Generates and optimizes a list of functions, reusing the stored bitcode of unchanged ones.
+     *
+     * A function's IR depends only on its own tokens, so its key (see
+     * CompileCache::computeFunctionKeys()) identifies it exactly. Functions
+     * found in the store are read from bitcode; the others are generated into
+     * a module of their own, optimized there and stored. All of them are then
+     * spliced into this module in source order. As every function is
+     * optimized on its own, optimizations across functions (e.g. merging
+     * equal strings) do not happen.
+     *
+     * @param functions Function nodes in source order.
+     * @param keys The key of every function (same order).
+     * @param store The per-function bitcode store.
+     * @param optimizer Optimizes new functions before they are stored.
+     * @return false if the program has duplicate function names; it is then
+     *         generated serially, without the store, and not optimized.
+     * @throws std::runtime_error if a new entry cannot be written.
      */
-    void generateCode(const FuncNode* funcAST);
+    bool generateIncremental(const std::vector<NodeId>& functions, const std::vector<std::string>& keys,
+                               CompileCache& store, Optimizer& optimizer);
+
+    /// @brief A module together with the context that owns it (the unit the JIT takes over)
+    struct GeneratedModule {
+        std::unique_ptr<llvm::LLVMContext> context;
+        std::unique_ptr<llvm::Module> module;
+    };
+
+    /**
+     * @brief Generates the functions into separate small modules.
+     *
+     * Used by --run: the JIT does per-module work on every lazy compile, so
+     * small modules keep the cost of reaching a function independent of the
+     * program size. If the program defines main, this module gets a
+     * declaration of it, so the wrapper created afterwards avoids the name.
+     * Programs with duplicate function names are generated into this
+     * module instead (see generateFunctions) and no modules are returned.
+     *
+     * @param functions Function nodes in source order.
+     * @param functionsPerModule Maximum number of functions per module.
+     * @return The modules in source order.
+     */
+    std::vector<GeneratedModule> generateModules(const std::vector<NodeId>& functions, size_t functionsPerModule);
 
     /**
      * @brief Creates a C-style main function wrapper that calls the generated target function.
      *
-     * @param targetFuncName The name of the function to be called by main.
+     * The wrapper returns the target's value converted to int32 (0 for a void
+     * target), so it is the exit status. The target is declared if it lives in
+     * another module (see generateModules()).
+     *
+     * @param function The Function node to be called by main (without parameters).
+     * @return The wrapper ("main", or "main.<n>" if the program defines main itself).
      */
-    void createMainWrapper(const std::string& targetFuncName);
+    llvm::Function* createMainWrapper(NodeId function);
 
     /**
-     * @brief Outputs the generated LLVM module on stdout.
+     * @brief Outputs the generated LLVM module as text.
+     *
+     * @param out The stream to print to (stdout by default).
      */
-    void printModule() const;
+    void printModule(llvm::raw_ostream& out = llvm::outs()) const;
 
     /**
      * @brief Access to the LLVM module.
@@ -57,44 +135,231 @@ public:
      * @return Reference to the unique_ptr that contains the module.
      */
     std::unique_ptr<llvm::Module>& getModule();
+
+    /**
+     * @brief Hands the LLVM context over (e.g. to the JIT, together with the module).
+     *
+     * The Codegen must not generate code afterwards.
+     *
+     * @return The context that owns all types and constants of the module.
+     */
+    std::unique_ptr<llvm::LLVMContext> takeContext();
     
 private:
-    llvm::LLVMContext context;                  ///< LLVM context
+    const SourceManager& sourceManager;         ///< Owner of the source text the AST refers to
+    const Ast& ast;                             ///< The program being compiled (annotated by Sema)
+    const TypeTable& typeTable;                 ///< Descriptions of the TypeIds in the AST
+    std::unique_ptr<llvm::LLVMContext> context; ///< LLVM context (owned, so it can move to the JIT)
     std::unique_ptr<llvm::Module> module;       ///< The LLVM module that contains the generated code
     llvm::IRBuilder<> builder;                  ///< Builder for the creation of LLVM IR
     llvm::FunctionCallee putsFunc;              ///< Declaration of the external C function puts
 
-    /// @brief Symbol table for the current function
-    std::map<std::string, llvm::AllocaInst*> namedValues;
+    /// @brief Symbol table for the current block (keys are views into the source buffer).
+    ///        vars, arrays and loop variables map to their stack slot (an alloca), all other names to their value
+    std::map<std::string_view, llvm::Value*> namedValues;
+
+    /// @brief Loop variables whose hoisted bounds checks passed (the unchecked version of their loop is emitted)
+    std::set<std::string_view> uncheckedLoops;
+
+    /// @brief The block a failed bounds check of the current function branches to (created on first use)
+    llvm::BasicBlock* boundsFailBlock = nullptr;
+
+    /// @brief for loops with a constant trip count up to this are fully unrolled (llvm.loop.unroll.full)
+    static constexpr uint64_t kFullUnrollTripCount = 16;
 
     /**
-     * @brief Converts a return type string into an LLVM type.
+     * @brief Converts a resolved type into an LLVM type.
      *
-     * Supported are char8/int8, char16/int16, char32/int32 and int64.
+     * @param type Id of a built-in, array, slice or vector type.
+     * @return The LLVM integer type of the same width, or void; [N x iM] for
+     *         an array, { iM*, i64 } (elements and their count) for a slice,
+     *         <N x iM> for a vector.
+     */
+    llvm::Type* getLLVMType(TypeId type);
+
+    /**
+     * @brief Converts value from type from to type to.
      *
-     * @param retTypeStr The string that describes the return type.
-     * @return Pointer to the corresponding LLVM type.
-     * @throws std::runtime_error if the type is not supported.
+     * Integers are sign- or zero-extended by the signedness of from; a scalar
+     * converted to a vector type is splat to all lanes.
      */
-    llvm::Type* getReturnType(const std::string &retTypeStr);
+    llvm::Value* convert(llvm::Value* value, TypeId from, TypeId to);
 
     /**
-     * @brief Checks if a type string represents an unsigned integer type.
+     * @brief Whether a function is private to the module: neither exported nor main.
      *
-     * Supported unsigned types are uchar8, uchar16, uchar32, uint8, uint16, uint32, uint64.
+     * Internal functions use the fast calling convention, so calls between
+     * them can be guaranteed tail calls, and the optimizer is free to inline,
+     * specialize or drop them.
+     */
+    static bool isInternal(const AstNode& function);
+
+    /// @brief Creates the LLVM function for a Function node (signature and calling convention; external linkage)
+    llvm::Function* createFunction(const AstNode& function);
+
+    /// @brief The LLVM function of a Function node in this module, declared if it does not exist yet
+    llvm::Function* declareFunction(NodeId function);
+
+    /// @brief Gives the internal functions among the defined ones internal linkage (once the module is complete)
+    void internalizeFunctions(const std::vector<NodeId>& functions);
+
+    /// @brief Whether no two functions share a name (LLVM would rename one of them)
+    bool hasUniqueNames(const std::vector<NodeId>& functions) const;
+
+    /// @brief Generates groups of functions on a thread pool and links the results into this module
+    void generateInParallel(const std::vector<NodeId>& functions, unsigned jobs);
+
+    /// @brief Declares the C function puts in the current module
+    void declarePuts();
+
+    /// @brief Generates a function into a new module of this context (this module is left unchanged)
+    std::unique_ptr<llvm::Module> generateIsolated(NodeId function);
+
+    /**
+     * @brief Moves the globals and functions of a module of this context into this module.
      *
-     * @param typeStr The string that describes the type.
-     * @return True if the type is unsigned, false otherwise.
+     * Unlike llvm::Linker, the cost depends only on the size of part, so
+     * thousands of one-function modules can be joined in linear time.
      */
-    bool isUnsignedType(const std::string &typeStr);
+    void spliceModule(std::unique_ptr<llvm::Module> part);
+
+    /// @brief Gives string constants the names a serial run would have assigned (after linking)
+    void renameStringConstants();
 
-    void generateConst(const ConstNode* constNode);
-    void generatePrint(const PrintNode* printNode);
-    void generateReturn(const ReturnNode* returnNode, llvm::Type* expectedRetType, bool isUnsigned);
-    std::pair<llvm::Value*, bool> generateExpression(const ASTNode* node);
+    /// @brief After linking: number of name clashes a serial run would have resolved so far
+    ///        (LLVM numbers clashing names with a per-module counter)
+    size_t serialRenameCount = 0;
+    bool linked = false;
 
-    /// @brief Tracks which variables are unsigned in the current scope
-    std::map<std::string, bool> isUnsignedVar;
+    /**
+     * @brief Emits the statements of a function or loop body at the insert point.
+     *
+     * Statements after a return are unreachable and not emitted.
+     *
+     * @param statements The statements in source order.
+     * @param returnType The return type of the function.
+     * @param isFunctionBody Whether the end of the statements is the end of the function (for tail calls).
+     */
+    void generateStatements(NodeRange statements, TypeId returnType, bool isFunctionBody);
+
+    void generateConst(const AstNode& constNode);
+    void generateVar(const AstNode& varNode);
+    void generateAssign(const AstNode& assignNode);
+    void generateIndexAssign(const AstNode& assignNode);
+
+    /// @brief Allocates a const or var array and fills it from its literal, or with zeros
+    void generateArray(const AstNode& decl);
+    void generatePrint(const AstNode& printNode);
+    void generateReturn(const AstNode& returnNode, TypeId returnType);
+
+    /**
+     * @brief Whether a call in tail position may be marked tail.
+     *
+     * A tail call between fastcc functions reuses the caller's frame, so no
+     * argument may point into it: calls with slice arguments (which may view
+     * a local array) are never marked.
+     */
+    bool canTailCall(const AstNode& call) const;
+
+    /// @brief Emits a while loop: the condition block, the body and the exit block the insert point moves to
+    void generateWhile(const AstNode& loop, TypeId returnType);
+
+    /**
+     * @brief Emits a counted for loop; its back edge carries the loop hints (see addLoopHints()).
+     *
+     * If the body has accesses with hoisted bounds checks, the loop is
+     * emitted twice: one check of the whole range in front of the loop
+     * enters a version without these checks, or else a version with them.
+     */
+    void generateFor(const AstNode& loop, TypeId returnType);
+
+    /// @brief Emits one version of a for loop: the index slot is set to start, the loop exits to exitBB
+    void generateForLoop(const AstNode& loop, llvm::Value* end, llvm::AllocaInst* slot,
+                         llvm::BasicBlock* exitBB, TypeId returnType);
+
+    /// @brief Adds the arrays, slices and vectors that are indexed by the loop variable name with a hoisted check
+    void collectHoisted(NodeRange statements, std::string_view name, std::vector<std::string_view>& bases) const;
+    void collectHoisted(NodeId expression, std::string_view name, std::vector<std::string_view>& bases) const;
+
+    /**
+     * @brief The elements of an array, slice or vector in scope: a pointer to them, their count (i64) and the array type (if any).
+     *
+     * The lanes of a vector are not in memory, so for a vector only the count is set.
+     */
+    struct Elements {
+        llvm::Value* data;
+        llvm::Value* length;
+        llvm::ArrayType* arrayType;
+    };
+    Elements getElements(std::string_view name);
+
+    /// @brief The value of a name in scope (loaded from its slot if it is a var)
+    llvm::Value* loadVariable(std::string_view name);
+
+    /// @brief The LLVM type of a vector in scope, nullptr if the name is not a vector
+    llvm::FixedVectorType* getVectorType(std::string_view name);
+
+    /// @brief Whether an Index, IndexAssign or Slice node is checked at run time where it is emitted
+    bool needsBoundsCheck(const AstNode& access) const;
+
+    /// @brief Emits the index of an Index or IndexAssign node as i64, with its bounds check against length
+    llvm::Value* generateIndex(const AstNode& access, llvm::Value* length);
+
+    /// @brief Emits the address of the element an Index or IndexAssign node refers to (with its bounds check)
+    llvm::Value* generateElementPointer(const AstNode& access);
+
+    /// @brief Emits a vector literal: its lanes are inserted one by one (folded if all are constant)
+    llvm::Value* generateVectorLiteral(const AstNode& literal);
+
+    /// @brief Emits a horizontal reduction of a vector (llvm.vector.reduce.*)
+    llvm::Value* generateReduction(const AstNode& reduce);
+
+    /// @brief Emits a slice of an array or slice (with its bounds check)
+    llvm::Value* generateSlice(const AstNode& slice);
+
+    /// @brief Continues at a new block if inBounds holds, else fails (see getBoundsFailBlock())
+    void generateBoundsCheck(llvm::Value* inBounds);
+
+    /// @brief The block failed bounds checks branch to (empty until generateBoundsFail())
+    llvm::BasicBlock* getBoundsFailBlock();
+
+    /// @brief Emits the failure block: writes "Index out of bounds" to stderr and traps
+    void generateBoundsFail();
+
+    /// @brief Emits a comparison as an i1 value
+    llvm::Value* generateCondition(NodeId id);
+
+    /// @brief Allocates a stack slot in the entry block of the current function (promoted to a register by the optimizer)
+    llvm::AllocaInst* createEntryAlloca(llvm::Type* type, std::string_view name);
+
+    /**
+     * @brief Attaches llvm.loop metadata to the back edge of a for loop.
+     *
+     * A counted loop always terminates (llvm.loop.mustprogress). A constant
+     * trip count of at most kFullUnrollTripCount asks for full unrolling;
+     * otherwise a body without calls, prints, returns, nested loops or
+     * bounds checks asks the loop vectorizer to vectorize it
+     * (llvm.loop.vectorize.enable).
+     */
+    void addLoopHints(llvm::BranchInst* backedge, const AstNode& loop);
+
+    /// @brief Whether a loop body only computes (no calls, prints, returns, nested loops or bounds checks)
+    bool isComputeOnly(NodeRange statements) const;
+
+    /// @brief Whether an expression contains neither a call nor a bounds check
+    bool computesOnly(NodeId id) const;
+
+    /// @brief Emits an expression; the value has the type Sema annotated the node with
+    llvm::Value* generateExpression(NodeId id);
+
+    /**
+     * @brief Formats a diagnostic that points at a node of the current source.
+     *
+     * @param node The node the diagnostic refers to.
+     * @param message The error message.
+     * @return The message prefixed with the file name, line and column.
+     */
+    std::string formatError(const AstNode& node, const std::string& message) const;
 
 };
 
@@ -0,0 +1,156 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TokenBuffer.h"
+
+/**
+ * @brief Content-addressed on-disk cache of compiler outputs (in the style of ccache).
+ *
+ * An entry is keyed by a SHA-256 over the compiler identity, the options
+ * that influence the output and the source bytes, and stores the finished
+ * artifact (IR text, assembly or object code) as a plain file:
+ *
+ *     <directory>/<first two hex digits>/<remaining digits>
+ *
+ * A hit skips the whole pipeline; the entry is mapped and written to the
+ * output in one go. Entries are written to a temporary file and renamed, so
+ * concurrent compilers never see a partial entry. The modification time of
+ * an entry is its last use; when the cache grows beyond its size limit the
+ * least recently used entries are removed. Counters live in a small stats
+ * file that is updated under an advisory lock; they are collected in memory
+ * and written by flush(), so thousands of lookups (e.g. the per-function
+ * store of --incremental) take the lock only once.
+ */
+class CompileCache {
+public:
+
+    /**
+     * @brief Constructor.
+     *
+     * @param directory The cache root (created on first use).
+     * @param maxBytes Size limit for all entries together.
+     */
+    CompileCache(std::string directory, uint64_t maxBytes);
+
+    /// @brief Flushes the pending counters (see flush())
+    ~CompileCache();
+
+    CompileCache(const CompileCache&) = delete;
+    CompileCache& operator=(const CompileCache&) = delete;
+
+    /// @brief $PICC_CACHE_DIR, else $XDG_CACHE_HOME/picc, else ~/.cache/picc
+    static std::string defaultDirectory();
+
+    /// @brief The per-function bitcode store of --incremental, next to the entries of the default directory
+    static std::string functionStoreDirectory();
+
+    /// @brief $PICC_CACHE_MAX_SIZE in MiB, else 512 MiB
+    static uint64_t defaultMaxBytes();
+
+    /**
+     * @brief Describes the running compiler for cache keys.
+     *
+     * Includes the picc and LLVM versions and the size and modification time
+     * of the executable, so a rebuilt compiler never reuses old entries.
+     *
+     * @param argv0 argv[0] of the running process.
+     */
+    static std::string compilerIdentity(const char* argv0);
+
+    /**
+     * @brief Computes the key of a compile.
+     *
+     * @param compiler The compilerIdentity().
+     * @param options Every option that changes the output (e.g. "-O2 -c").
+     * @param source The source bytes.
+     * @return 64 hex digits.
+     */
+    static std::string computeKey(const std::string& compiler, const std::string& options, std::string_view source);
+
+    /**
+     * @brief Computes the key of every top-level function (for --incremental).
+     *
+     * A function's key covers the kinds and spellings of its tokens, so
+     * whitespace, comments and edits to other functions leave it unchanged.
+     * The headers of the functions it calls are included as well, since a
+     * call depends on the callee's parameters, return type and linkage.
+     *
+     * @param compiler The compilerIdentity().
+     * @param options Every option that changes the stored functions (e.g. "-O2").
+     * @param tokens The whole token stream of the source.
+     * @param boundaries Index of the first token of every function (see Parser::findFunctionBoundaries()).
+     * @return One key per boundary, in source order.
+     */
+    static std::vector<std::string> computeFunctionKeys(const std::string& compiler, const std::string& options,
+                                                        const TokenBuffer& tokens, const std::vector<size_t>& boundaries);
+
+    /**
+     * @brief Looks up an entry and counts the hit or miss.
+     *
+     * A hit marks the entry as most recently used.
+     *
+     * @return The path of the entry file, or an empty string on a miss.
+     */
+    std::string lookup(const std::string& key);
+
+    /**
+     * @brief Adds an entry.
+     *
+     * Old entries are evicted on the next flush() if the cache is over its limit.
+     *
+     * @return The path of the entry file.
+     * @throws std::runtime_error if the entry cannot be written.
+     */
+    std::string store(const std::string& key, std::string_view data);
+
+    /**
+     * @brief Writes a whole file to a descriptor (the file is mapped, not read).
+     *
+     * @throws std::runtime_error on I/O errors.
+     */
+    static void copyFile(const std::string& path, int fd);
+
+    /**
+     * @brief Adds the pending counters to the stats file and evicts entries if
+     *        the cache is over its limit.
+     */
+    void flush();
+
+    /// @brief Hits, misses, entries, size and evictions as a small report
+    std::string formatStats();
+
+private:
+    std::string directory;
+    uint64_t maxBytes;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    Stats pending;  ///< Counted since the last flush()
+    bool dirty = false;
+
+    std::string entryPath(const std::string& key) const;
+
+    /**
+     * @brief Reads, modifies and writes the stats file under an exclusive lock.
+     *
+     * @param update Called with the current counters; may change them.
+     */
+    template <typename Update>
+    void updateStats(Update update);
+
+    /// @brief Removes least recently used entries until the cache is below 90% of the limit
+    void evict(Stats& stats);
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef COMPILE_SERVER_H
+#define COMPILE_SERVER_H
+
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+/// @brief One picc invocation: the command line without --server/--client, returns the exit status
+using CompileFunction = std::function<int(int argc, char** argv)>;
+
+/**
+ * @brief Persistent compile server on a Unix domain socket (picc --server).
+ *
+ * The server initializes LLVM once and then forks a child per request, so a
+ * compile starts from a warm process image instead of a fresh exec: no
+ * dynamic loading, no static initializers, no target initialization.
+ * Children run concurrently and are isolated from each other and from the
+ * server; a crash only ends its own request.
+ *
+ * A client (picc --client) sends its working directory, its command line,
+ * its environment and its standard input, output and error descriptors
+ * (SCM_RIGHTS). The child takes all of them over, so a request behaves
+ * exactly like the same command run locally, including inline sources read
+ * from stdin, output files relative to the client's directory and programs
+ * started with --run. When the child has exited, the server sends its exit
+ * status back.
+ */
+class CompileServer {
+public:
+
+    /// @param socketPath The socket to listen on.
+    explicit CompileServer(std::string socketPath);
+
+    /// @brief $PICC_SERVER_SOCKET, else $XDG_RUNTIME_DIR/picc.sock, else /tmp/picc-<uid>.sock
+    static std::string defaultSocketPath();
+
+    /**
+     * @brief Serves requests until SIGINT or SIGTERM.
+     *
+     * @param compile Runs one request in the forked child.
+     * @param argv0 argv[0] of the server (passed on as argv[0] of every request).
+     * @return The exit status of the server.
+     * @throws std::runtime_error if the socket cannot be set up or another server is listening.
+     */
+    int serve(const CompileFunction& compile, const char* argv0);
+
+    /**
+     * @brief Runs a command line on a server (client side).
+     *
+     * @param socketPath The server's socket.
+     * @param args The command line without argv[0].
+     * @return The exit status of the request, or nothing if no server is listening.
+     * @throws std::runtime_error if the server fails during the request.
+     */
+    static std::optional<int> request(const std::string& socketPath, const std::vector<std::string>& args);
+
+private:
+    std::string socketPath;
+    int listenFd = -1;
+
+    /// @brief Connections of running requests by the pid of their child
+    std::map<int, int> running;
+
+    /// @brief Creates, binds and listens on the socket
+    void listenOnSocket();
+
+    /// @brief Sends the exit status of every finished child to its client
+    void reapChildren();
+
+    /// @brief Sends the exit status of a child (waitpid format) to its client and closes the connection
+    void finishRequest(int child, int status);
+
+    /// @brief Child side: takes the request over and runs it (never returns)
+    [[noreturn]] void handleRequest(int connection, const CompileFunction& compile, const char* argv0);
+};
+
+#endif
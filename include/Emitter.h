@@ -0,0 +1,96 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include <memory>
+#include <string>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "Optimizer.h"
+
+/// @brief What picc writes at the end of a compile
+enum class OutputKind : uint8_t {
+    IR,             ///< Textual LLVM IR (default, on stdout)
+    Assembly,       ///< -S
+    Object,         ///< -c
+    Executable      ///< -o without -c / -S
+};
+
+/**
+ * @brief Turns an optimized module into native code.
+ *
+ * Assembly and object files are produced by the host TargetMachine
+ * (addPassesToEmitFile), so no llc step is needed. Executables are linked
+ * by the system C compiler driver ($CC, or cc), which adds the C runtime
+ * and libc for puts.
+ */
+class Emitter {
+public:
+
+    /// @param level Optimization level for instruction selection and scheduling.
+    explicit Emitter(OptLevel level);
+
+    /**
+     * @brief Writes the module as assembly or object file.
+     *
+     * Sets the module's target triple and data layout to the host's.
+     *
+     * @param module The module to emit.
+     * @param kind OutputKind::Assembly or OutputKind::Object.
+     * @param path The output file ("-" writes to stdout).
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void emitFile(llvm::Module& module, OutputKind kind, const std::string& path);
+
+    /**
+     * @brief Emits assembly or object code into memory (e.g. for the compile cache).
+     *
+     * @param module The module to emit.
+     * @param kind OutputKind::Assembly or OutputKind::Object.
+     * @return The emitted bytes.
+     */
+    llvm::SmallVector<char, 0> emitToMemory(llvm::Module& module, OutputKind kind);
+
+    /**
+     * @brief Writes the module as textual IR (the output of a batch compile without -c / -S).
+     *
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    static void writeIR(const llvm::Module& module, const std::string& path);
+
+    /**
+     * @brief Compiles the module into a temporary object file and links it.
+     *
+     * @param module The module to emit.
+     * @param path The executable to create.
+     * @throws std::runtime_error if emitting or linking fails.
+     */
+    void emitExecutable(llvm::Module& module, const std::string& path);
+
+    /**
+     * @brief The default output file for an input, like a C compiler picks it.
+     *
+     * @param inputPath The source file ("-" for stdin).
+     * @param kind The output kind.
+     * @return foo.ll / foo.s / foo.o / a.out for foo.pi.
+     */
+    static std::string defaultOutputPath(const std::string& inputPath, OutputKind kind);
+
+    /**
+     * @brief Links an object file into an executable with the C compiler driver.
+     *
+     * @throws std::runtime_error if the driver is missing or fails.
+     */
+    static void linkExecutable(const std::string& objectPath, const std::string& path);
+
+private:
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+
+    /// @brief Runs the code generator of the target machine into out
+    void emit(llvm::Module& module, OutputKind kind, llvm::raw_pwrite_stream& out);
+};
+
+#endif
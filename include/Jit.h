@@ -0,0 +1,47 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <string>
+#include <vector>
+
+#include "Codegen.h"
+#include "Optimizer.h"
+
+/**
+ * @brief Runs a generated module in-process (picc --run).
+ *
+ * Uses ORC's LLLazyJIT: every function is replaced by a stub and only
+ * compiled when it is called for the first time, so a large program only
+ * pays for the functions it actually reaches. The optimization pipeline runs
+ * on each lazily compiled piece, so unreached functions are not optimized
+ * either. External symbols such as puts are resolved against the picc
+ * process itself.
+ */
+class Jit {
+public:
+
+    /**
+     * @brief Constructor.
+     *
+     * @param level Optimization level for the IR pipeline and instruction selection.
+     * @param timePasses Whether to profile every pass (--time-passes).
+     */
+    Jit(OptLevel level, bool timePasses);
+
+    /**
+     * @brief Adds the modules to the JIT, compiles the entry function lazily and calls it.
+     *
+     * @param modules The program (e.g. from Codegen::generateModules()); ownership is taken over.
+     * @param entryName Name of a function of type int32() (the main wrapper).
+     * @return The entry function's return value.
+     * @throws std::runtime_error if the JIT cannot be created, a module is rejected
+     *         or a symbol is missing.
+     */
+    int run(std::vector<Codegen::GeneratedModule> modules, const std::string& entryName);
+
+private:
+    OptLevel level;
+    Optimizer optimizer;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "Token.h"
+
+/// @brief Spelling of a reserved word and the token it produces
+struct Keyword {
+    std::string_view spelling;
+    TokenType type;
+};
+
+/**
+ * @brief All reserved words of the language.
+ *
+ * New keywords and type names only need an entry here. The lexer looks words
+ * up through a perfect hash that is computed from this table at compile time.
+ */
+inline constexpr Keyword keywordTable[] = {
+    {"func",   TOKEN_FUNC},
+    {"export", TOKEN_EXPORT},
+    {"return", TOKEN_RETURN},
+    {"start",  TOKEN_START},
+    {"print",  TOKEN_PRINT},
+    {"const",  TOKEN_CONST},
+    {"var",    TOKEN_VAR},
+    {"while",  TOKEN_WHILE},
+    {"for",    TOKEN_FOR},
+    {"in",     TOKEN_IN},
+    {"len",    TOKEN_LEN},
+    {"reduce", TOKEN_REDUCE},
+    {"void",   TOKEN_VOID},
+
+    // CHARACTER TYPES
+    {"char8",  TOKEN_CHAR8},
+    {"char16", TOKEN_CHAR16},
+    {"char32", TOKEN_CHAR32},
+
+    // INTEGER TYPES
+    {"int8",   TOKEN_INT8},
+    {"int16",  TOKEN_INT16},
+    {"int32",  TOKEN_INT32},
+    {"int64",  TOKEN_INT64},
+
+    // UNSIGNED INTEGER TYPES
+    {"uint8",  TOKEN_UINT8},
+    {"uint16", TOKEN_UINT16},
+    {"uint32", TOKEN_UINT32},
+    {"uint64", TOKEN_UINT64},
+};
+
+namespace keywords {
+
+constexpr size_t kKeywordCount = sizeof(keywordTable) / sizeof(keywordTable[0]);
+
+/// @brief Number of hash slots (power of two, kept sparse so a seed is found quickly)
+constexpr size_t kSlotCount = 128;
+constexpr uint8_t kEmptySlot = 0xFF;
+
+static_assert(kKeywordCount < kEmptySlot, "Keyword indices must fit into a slot");
+
+/// @brief Seeded FNV-1a hash reduced to a slot index
+constexpr size_t hash(std::string_view word, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : word) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return (h ^ (h >> 15)) & (kSlotCount - 1);
+}
+
+/// @brief Checks whether the keyword table hashes without collisions for seed
+constexpr bool isPerfect(uint32_t seed) {
+    bool used[kSlotCount] = {};
+    for (const Keyword& keyword : keywordTable) {
+        size_t slot = hash(keyword.spelling, seed);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+/// @brief Searches the first seed that makes the hash perfect (0 if none was found)
+constexpr uint32_t findSeed() {
+    for (uint32_t seed = 1; seed < 100000; ++seed) {
+        if (isPerfect(seed)) return seed;
+    }
+    return 0;
+}
+
+constexpr uint32_t kSeed = findSeed();
+static_assert(kSeed != 0, "No perfect hash seed for the keyword table; increase kSlotCount");
+
+/// @brief Slot -> index into keywordTable (kEmptySlot if unused)
+constexpr std::array<uint8_t, kSlotCount> buildSlots() {
+    std::array<uint8_t, kSlotCount> slots {};
+    for (auto& slot : slots) slot = kEmptySlot;
+    for (size_t i = 0; i < kKeywordCount; ++i) {
+        slots[hash(keywordTable[i].spelling, kSeed)] = static_cast<uint8_t>(i);
+    }
+    return slots;
+}
+
+constexpr std::array<uint8_t, kSlotCount> kSlots = buildSlots();
+
+constexpr size_t minLength() {
+    size_t result = keywordTable[0].spelling.size();
+    for (const Keyword& keyword : keywordTable)
+        if (keyword.spelling.size() < result) result = keyword.spelling.size();
+    return result;
+}
+
+constexpr size_t maxLength() {
+    size_t result = 0;
+    for (const Keyword& keyword : keywordTable)
+        if (keyword.spelling.size() > result) result = keyword.spelling.size();
+    return result;
+}
+
+constexpr size_t kMinLength = minLength();
+constexpr size_t kMaxLength = maxLength();
+
+} // namespace keywords
+
+/**
+ * @brief Classifies a word as keyword or identifier.
+ *
+ * @param word The spelling of an identifier-like lexeme.
+ * @return The keyword token type, or TOKEN_IDENT if the word is not reserved.
+ */
+constexpr TokenType lookupKeyword(std::string_view word) {
+    if (word.size() < keywords::kMinLength || word.size() > keywords::kMaxLength)
+        return TOKEN_IDENT;
+
+    uint8_t index = keywords::kSlots[keywords::hash(word, keywords::kSeed)];
+    if (index != keywords::kEmptySlot && keywordTable[index].spelling == word)
+        return keywordTable[index].type;
+
+    return TOKEN_IDENT;
+}
+
+static_assert(lookupKeyword("func") == TOKEN_FUNC, "Keyword lookup is broken");
+static_assert(lookupKeyword("uint64") == TOKEN_UINT64, "Keyword lookup is broken");
+static_assert(lookupKeyword("funcs") == TOKEN_IDENT, "Keyword lookup is broken");
+
+#endif
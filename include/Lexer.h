@@ -1,22 +1,30 @@
 #ifndef LEXER_H
 #define LEXER_H
 
-#include <string>
+#include <string_view>
 #include <vector>
 
+#include "LexerScan.h"
+#include "SourceManager.h"
 #include "Token.h"
+#include "TokenBuffer.h"
+#include "TokenStream.h"
 
-class Lexer {
+class Lexer : public TokenSource {
 public:
-    Lexer(const std::string &source);
-    std::vector<Token> tokenize();
+    Lexer(SourceManager &sourceManager);
+
+    /// @brief Scans and returns the next token (pull mode, used by the parser)
+    Token next() override;
+
+    /// @brief Scans the whole source at once into a compact buffer (eager mode)
+    TokenBuffer tokenize();
 
 private:
-    std::string source;
+    std::string_view source;    // Non-owning view of the SourceManager buffer
     size_t index;
-    
-    int line;   // Current line number
-    int column; // Current column number
+
+    const ScanKernels& kernels; // Bulk scanning kernels for whitespace, comments and strings
 
     char currentChar();
     void advance();
@@ -0,0 +1,40 @@
+#ifndef LEXER_SCAN_H
+#define LEXER_SCAN_H
+
+#include <cstddef>
+
+/**
+ * @brief Bulk scanning kernels used by the lexer's fast paths.
+ *
+ * The lexer spends most of its time skipping whitespace, comments and string
+ * bodies. These kernels process 16 (SSE2) or 32 (AVX2) bytes per step instead
+ * of one character at a time. The implementation is chosen once at runtime
+ * based on the CPU; a portable scalar version is always available.
+ *
+ * All functions work on the range [pos, size) of data and return size if
+ * nothing was found.
+ */
+struct ScanKernels {
+
+    /// @brief Name of the instruction set ("avx2", "sse2" or "scalar")
+    const char* name;
+
+    /// @brief Returns the position of the first byte at or after pos that is not whitespace
+    size_t (*skipWhitespace)(const char* data, size_t size, size_t pos);
+
+    /// @brief Returns the position of the first byte at or after pos that equals a or b
+    size_t (*findEither)(const char* data, size_t size, size_t pos, char a, char b);
+
+    /// @brief Counts the occurrences of target in [pos, size)
+    size_t (*count)(const char* data, size_t size, size_t pos, char target);
+};
+
+/**
+ * @brief Returns the best kernels supported by the running CPU.
+ *
+ * The selection can be overridden with the environment variable
+ * PICC_LEXER_KERNELS=scalar|sse2|avx2 (useful for testing and benchmarks).
+ */
+const ScanKernels& getScanKernels();
+
+#endif
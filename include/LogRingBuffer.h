@@ -0,0 +1,104 @@
+#ifndef LOG_RING_BUFFER_H
+#define LOG_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+enum class LogLevel;
+
+/// @brief A pre-formatted log line travelling from a producer to the log writer
+struct LogRecord {
+    LogLevel level;
+    bool toConsole = false;     ///< Passed the console log level when it was produced
+    bool raw = false;           ///< Written verbatim (no color, no trailing newline)
+    std::string text;
+    bool toFile = true;         ///< Passed the file log level when it was produced
+};
+
+/**
+ * @brief Bounded lock-free multi-producer / single-consumer queue of log records.
+ *
+ * Based on Dmitry Vyukov's bounded queue: every slot carries a sequence
+ * number that tells producers and the consumer whether the slot is free or
+ * filled, so a push is a single CAS on the tail and never takes a lock.
+ */
+class LogRingBuffer {
+public:
+
+    /// @param capacity Number of slots (rounded up to a power of two).
+    explicit LogRingBuffer(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        slots = std::make_unique<Slot[]>(size);
+        for (size_t i = 0; i < size; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    LogRingBuffer(const LogRingBuffer&) = delete;
+    LogRingBuffer& operator=(const LogRingBuffer&) = delete;
+
+    /**
+     * @brief Tries to enqueue a record (any thread).
+     *
+     * @param record The record; moved from on success only.
+     * @param position Receives the sequence position of the record (0-based).
+     * @return False if the buffer is full.
+     */
+    bool tryPush(LogRecord& record, size_t& position) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.record = std::move(record);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    position = pos;
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // The consumer has not freed this slot yet
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Dequeues the oldest record (consumer thread only).
+     *
+     * @param record Receives the record.
+     * @return False if the buffer is empty.
+     */
+    bool tryPop(LogRecord& record) {
+        Slot& slot = slots[head & mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != head + 1)
+            return false;
+
+        record = std::move(slot.record);
+        slot.sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> tail {0};   ///< Next slot to fill (shared by producers)
+    alignas(64) size_t head = 0;                ///< Next slot to drain (consumer only)
+};
+
+#endif
@@ -1,14 +1,18 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <atomic>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
-#include <map>
-#include <vector>
+#include <thread>
 #include <chrono>
+#include <condition_variable>
+
+#include "LogRingBuffer.h"
 
 enum class LogLevel {
 
@@ -38,17 +42,56 @@ public:
     void log(LogLevel level, const std::string& message, const std::string& file = "", int line = 0);
 
     void setLogLevel(LogLevel level);
-    void enableFileLogging(const std::string& filename);
+
+    /**
+     * @brief Also writes log lines to a file.
+     *
+     * @param filename The file to append to.
+     * @param level Minimum level written to the file (independent of the console level).
+     */
+    void enableFileLogging(const std::string& filename, LogLevel level = LogLevel::TRACE);
     void disableFileLogging();
 
+    /// @brief True if a message of this level would reach the console or the log file
+    bool isEnabled(LogLevel level) const {
+        return level >= currentLogLevel.load(std::memory_order_relaxed)
+            || (fileLoggingEnabled.load(std::memory_order_relaxed) && level >= fileLogLevel.load(std::memory_order_relaxed));
+    }
+
+    /// @brief Writes text verbatim to the console and the log file, in order with the log lines
+    void output(const std::string& text);
+
+    /**
+     * @brief Rotates the log file once it would grow beyond maxBytes.
+     *
+     * The current file is renamed to <name>.1, older files shift up to
+     * <name>.<maxFiles>; the oldest one is dropped. A maxBytes of 0 disables rotation.
+     */
+    void setFileRotation(size_t maxBytes, int maxFiles);
+
+    /**
+     * @brief Switches to asynchronous logging.
+     *
+     * Producers format their record and push it into a lock-free ring buffer;
+     * a background thread writes the records in batches. CRITICAL messages are
+     * flushed before log() returns, everything else at the latest on
+     * disableAsyncLogging() or when the program exits.
+     *
+     * @param capacity Number of records the ring buffer can hold.
+     */
+    void enableAsyncLogging(size_t capacity = 16384);
+
+    /// @brief Drains the ring buffer, stops the writer thread and returns to synchronous logging.
+    ///        Call only while no other thread is logging (e.g. at shutdown).
+    void disableAsyncLogging();
+
+    /// @brief Blocks until every record logged so far has been written and flushed
+    void flush();
+
     void increaseIndent();
     void decreaseIndent();
     int getIndentation() const;
 
-    void recordScopeDuration(const std::string& scopeName, double durationMs, bool isRoot);
-    void registerScopeStart(const std::string& scopeName);
-    void printPerformanceSummary();
-
 private:
     Logger();
     ~Logger();
@@ -57,19 +100,31 @@ private:
     Logger& operator=(const Logger&) = delete;
 
     std::ofstream logFile;
-    LogLevel currentLogLevel;
-    std::mutex logMutex;
-
-    // Profiling data
-    struct ScopeStats {
-        double totalDurationMs = 0.0;
-        int count = 0;
-        bool isRoot = false;
-    };
-    std::map<std::string, ScopeStats> scopeStatsMap;
-    std::vector<std::string> insertionOrder;
-    std::chrono::steady_clock::time_point appStartTime;
-    
+    std::string logFileName;
+    size_t logFileSize = 0;             ///< Bytes in the current log file (for rotation)
+    size_t maxLogFileBytes = 0;         ///< Rotation threshold (0 = never rotate)
+    int maxLogFiles = 0;                ///< Number of rotated files to keep
+    std::atomic<bool> fileLoggingEnabled {false};
+    std::atomic<LogLevel> fileLogLevel {LogLevel::TRACE};
+
+    std::atomic<LogLevel> currentLogLevel;
+    std::mutex logMutex;                ///< Guards the streams (taken by the writer, not by async producers)
+
+    // Asynchronous mode
+    std::unique_ptr<LogRingBuffer> ringBuffer;
+    std::thread writerThread;
+    std::atomic<bool> asyncEnabled {false};
+    std::atomic<bool> stopWriter {false};
+    std::atomic<size_t> recordsWritten {0};     ///< Records drained and flushed (in ring order)
+
+    /// @brief Cuts the writer's idle sleep short when someone waits for it (flush, shutdown)
+    std::mutex wakeupMutex;
+    std::condition_variable writerWakeup;
+    bool wakeupRequested = false;
+
+    /// @brief Wakes the writer thread if it is idle
+    void wakeWriter();
+
     // We will use thread_local in the implementation, but we can expose helper methods here.
     // No member variable needed for thread_local indentation as it is static/global per thread.
 
@@ -78,6 +133,18 @@ private:
     std::string getColorCode(LogLevel level);
     void writeLog(LogLevel level, const std::string& message, const std::string& file, int line);
 
+    /// @brief Hands a record to the writer thread (async) or writes it directly (sync)
+    void submit(LogRecord record);
+
+    /// @brief Writes one record to the streams (caller holds logMutex)
+    void writeRecord(const LogRecord& record);
+
+    /// @brief Renames the log files and reopens an empty one (caller holds logMutex)
+    void rotateLogFile();
+
+    /// @brief Main loop of the asynchronous writer thread
+    void writerLoop();
+
 };
 
 #define LOG_TRACE(message) Logger::getInstance().log(LogLevel::TRACE, message, __FILE__, __LINE__)
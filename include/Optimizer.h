@@ -0,0 +1,103 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "Profiler.h"
+
+/// @brief Optimization level selected with -O0 .. -O3
+enum class OptLevel : uint8_t {
+    O0,
+    O1,
+    O2,
+    O3
+};
+
+/**
+ * @brief Runs LLVM's optimization pipeline on a generated module.
+ *
+ * Uses the new pass manager with the PassBuilder default pipeline of the
+ * requested level, tuned for the host target. Optimizing in-process saves the
+ * extra opt invocation and the re-parse of the printed IR.
+ *
+ * With pass timing enabled every pass and analysis run is recorded by the
+ * Profiler as a child scope of the enclosing scope, so the times show up in
+ * the performance summary and in the time trace.
+ *
+ * The target machine, pass builder and analysis managers are created on the
+ * first run() and reused for every further module, which matters when many
+ * small modules are optimized one by one (the lazy JIT, --incremental).
+ */
+class Optimizer {
+public:
+
+    /**
+     * @brief Constructor.
+     *
+     * @param level The optimization level (O0 leaves the module untouched).
+     * @param timePasses Whether to profile every pass (--time-passes).
+     */
+    Optimizer(OptLevel level, bool timePasses);
+    ~Optimizer();
+
+    /**
+     * @brief Optimizes the module in place.
+     *
+     * Above O0 the module gets the host target triple and data layout, so
+     * target-dependent passes (e.g. the vectorizers) can use the cost model.
+     *
+     * @param module The verified module to optimize.
+     * @throws std::runtime_error if the host target is not available.
+     */
+    void run(llvm::Module& module);
+
+    /**
+     * @brief Creates a TargetMachine for the host.
+     *
+     * @param level The optimization level for instruction selection.
+     * @throws std::runtime_error if the host target is not available.
+     */
+    static std::unique_ptr<llvm::TargetMachine> createHostTargetMachine(OptLevel level);
+
+    /**
+     * @brief Options of every TargetMachine picc creates (also the JIT's).
+     *
+     * Guaranteed tail call optimization: a call marked tail in tail position
+     * between two fastcc functions never grows the stack.
+     */
+    static llvm::TargetOptions targetOptions();
+
+private:
+    OptLevel level;
+    bool timePasses;
+
+    /// @brief Target machine, pass builder and analysis managers (created on first use)
+    struct Pipeline;
+    std::unique_ptr<Pipeline> pipeline;
+
+    /// @brief Creates the target machine and the pass builder and registers all analyses
+    void buildPipeline();
+
+    /// @brief A pass or analysis that is currently running (passes nest, e.g. adaptors)
+    struct RunningPass {
+        uint32_t node;
+        uint64_t startNs;
+        std::string detail;
+    };
+    std::vector<RunningPass> running;
+
+    /// @brief Profile sites by pass name (getDynamicSite takes a lock)
+    std::unordered_map<std::string, const ProfileSite*> passSites;
+
+    void beginPass(llvm::StringRef name, std::string detail);
+    void endPass();
+};
+
+#endif
@@ -1,83 +1,103 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <memory>
+#include <array>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "AST.h"
 #include "Lexer.h"
+#include "TokenBuffer.h"
+#include "TokenStream.h"
 
-/// @brief Base class for AST nodes
-struct ASTNode {
-    Token token;
-    virtual ~ASTNode() = default;
-};
+class Parser {
+public:
 
-/// @brief AST node for a print command
-struct PrintNode : public ASTNode {
-    std::string text;
-};
+    /**
+     * @brief Constructor.
+     *
+     * Tokens are pulled from the source on demand, so only a small window
+     * of tokens is held in memory at any time.
+     *
+     * @param source The token source (a Lexer, or a TokenBufferSource in eager mode).
+     * @param sourceManager The source the tokens refer to (used to locate errors).
+     * @param ast The tree the parsed nodes are appended to.
+     */
+    Parser(TokenSource& source, const SourceManager& sourceManager, Ast& ast);
+
+    /**
+     * @brief Parses a whole source on several threads.
+     *
+     * The source is tokenized eagerly, split before every top-level function
+     * (found by a pre-scan that tracks brace depth) and the slices are parsed
+     * on a thread pool into separate Asts, which are appended in source order.
+     *
+     * Errors are not reported from here: the caller re-parses serially, so
+     * diagnostics are exactly those (and in the order) of a serial parse.
+     *
+     * @param sourceManager The source to parse (identifiers are interned while tokenizing).
+     * @param ast Receives the program; left in an unspecified state on failure.
+     * @param jobs Number of worker threads.
+     * @return false if tokenizing or parsing any slice failed.
+     */
+    static bool parseInParallel(SourceManager& sourceManager, Ast& ast, unsigned jobs);
+
+    /// @brief Indices of the first token of every top-level function (index 0 always starts a slice)
+    static std::vector<size_t> findFunctionBoundaries(const TokenBuffer& tokens);
+
+    /// @brief Parses one function and records it in the Ast's function list
+    NodeId parseFunction();
+    NodeId parseStatement();
+    
+    /// @brief Check if parser reached end of file
+    bool isAtEOF() const;
+    
+    // Expression parsing
+    NodeId parseExpression();
+    NodeId parseTerm();
+    NodeId parseFactor();
 
+    /// @brief Parses the arguments of a call; the callee name has been consumed
+    NodeId parseCall(const Token& callee);
 
-/// @brief AST node for numbers
-struct NumberNode : public ASTNode {
-    int64_t value;
-};
+    /// @brief Parses an index or a slice of an array or slice; the name has been consumed
+    NodeId parseIndex(const Token& name);
 
-/// @brief AST node for characters
-struct CharNode : public ASTNode {
-    char value;
-};
+    /// @brief Parses "[<element>, ...]"
+    NodeId parseArrayLiteral();
 
-/// @brief AST node for binary operations
-struct BinaryOpNode : public ASTNode {
-    std::unique_ptr<ASTNode> left;
-    std::unique_ptr<ASTNode> right;
-    std::string op;
-};
+    /// @brief Parses a comparison of two expressions (the condition of a while loop)
+    NodeId parseCondition();
 
-/// @brief AST node for functions
-struct FuncNode : public ASTNode {
-    std::string name;
-    std::string returnType;
-    std::vector<std::unique_ptr<ASTNode>> body;     // Series of statements
-};
+private:
+    /// @brief Parses "{ <statements> }" and appends the statements
+    void parseBlock(std::vector<NodeId>& statements);
 
-/// @brief AST node for constants
-struct ConstNode : public ASTNode {
-    std::string name;
-    std::string type;
-    std::unique_ptr<ASTNode> value;
-};
+    /// @brief Parses a type keyword, array, slice or vector type into its TypeId
+    TypeId parseType();
 
-/// @brief AST node for variable usage in expressions
-struct VariableNode : public ASTNode {
-    std::string name;
-};
+    /// @brief Parses [N]T or []T (the element type must be an integer or character type)
+    TypeId parseAggregateType();
 
-/// @brief AST node for return statements
-struct ReturnNode : public ASTNode {
-    std::unique_ptr<ASTNode> returnValue; // Optional return value
-};
+    /// @brief Parses vecN<T> (N a power of two from 2 to 64, T an integer type)
+    TypeId parseVectorType();
 
-class Parser {
-public:
-    Parser(const std::vector<Token>& tokens);
-    std::unique_ptr<FuncNode> parseFunction();
-    std::unique_ptr<ASTNode> parseStatement();
-    
-    /// @brief Check if parser reached end of file
-    bool isAtEOF() const;
-    
-    // Expression parsing
-    std::unique_ptr<ASTNode> parseExpression();
-    std::unique_ptr<ASTNode> parseTerm();
-    std::unique_ptr<ASTNode> parseFactor();
+    /// @brief Number of buffered tokens: previous + current + lookahead (power of two)
+    static constexpr size_t kRingSize = 4;
 
-private:
-    std::string parseType();
-    std::vector<Token> tokens; // Owns the tokens now to ensure EOF safety
-    size_t index;
+    TokenSource& source;
+    const SourceManager& sourceManager;
+    Ast& ast;
+    std::array<Token, kRingSize> ring;  // Sliding window over the token stream
+    size_t index;                       // Absolute position of the current token
+    size_t pulled;                      // Number of tokens pulled from the source so far
+
+    /// @brief Token at absolute position pos (must lie inside the window)
+    const Token& tokenAt(size_t pos) const;
+
+    /// @brief Pulls tokens from the source until position pos is buffered
+    void fill(size_t pos);
 
     /// @brief Get the current token
     const Token& currentToken() const;
@@ -89,8 +109,19 @@ private:
     bool check(TokenType type) const;
     bool match(const std::vector<TokenType>& types);
     const Token& consume(TokenType type, const std::string& message);
+
+    /// @brief Throws a syntax error located at the current token
+    [[noreturn]] void syntaxError(const std::string& message) const;
     const Token& peek() const;
+
+    /// @brief Look at the token distance positions after the current one (at most kRingSize - 2)
+    const Token& peekAhead(size_t distance);
+
+    /// @brief The last consumed token (references stay valid until the window moves on)
     const Token& previous() const;
+
+    /// @brief "Line L, column C" of a token, for syntax errors
+    std::string describeLocation(const Token& token) const;
     
 };
 
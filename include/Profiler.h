@@ -0,0 +1,177 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief A statically registered profiling call site.
+ *
+ * LOG_SCOPE creates one function-local static ProfileSite per call site, so
+ * the name is registered once and the hot path only deals with a numeric id.
+ */
+struct ProfileSite {
+    ProfileSite(const char* name, const char* file, int line);
+
+    const char* name;
+    const char* file;
+    int line;
+    uint32_t id;
+};
+
+/**
+ * @brief Low-overhead hierarchical scope profiler.
+ *
+ * Every thread accumulates into its own call tree without locks. A node is
+ * identified by its call path, so the same scope reached from different
+ * parents is reported separately. Each node keeps count, inclusive time,
+ * time spent in children, min/max and a log-linear histogram for percentiles.
+ * The trees of all threads are merged when the summary is printed.
+ *
+ * With tracing enabled every span is additionally recorded with its start
+ * time, so the run can be exported as a Chrome trace (one lane per thread).
+ */
+class Profiler {
+public:
+    static Profiler& getInstance();
+
+    /// @brief Monotonic timestamp in nanoseconds (clock_gettime(CLOCK_MONOTONIC))
+    static uint64_t now();
+
+    /// @brief Assigns the next site id (called once per call site)
+    uint32_t registerSite(const ProfileSite* site);
+
+    /**
+     * @brief Returns a site for a name that is only known at runtime.
+     *
+     * Sites are created once per distinct name and live until the program ends.
+     * Takes a lock, so callers should cache the result.
+     */
+    const ProfileSite& getDynamicSite(const std::string& name);
+
+    /// @brief Enters the scope of site on the calling thread; returns the token for leave()
+    uint32_t enter(const ProfileSite& site);
+
+    /**
+     * @brief Leaves the scope entered with enter().
+     *
+     * @param node The token returned by enter().
+     * @param startNs The entry timestamp.
+     * @param detail Shown with the span in the trace (e.g. the function name).
+     */
+    void leave(uint32_t node, uint64_t startNs, std::string_view detail = {});
+
+    /**
+     * @brief Starts recording individual spans for writeTrace().
+     *
+     * @param granularityNs Spans shorter than this are not recorded.
+     */
+    void enableTracing(uint64_t granularityNs = 0);
+
+    /// @brief Starts the application time anew (a compile server request is a fork of a long-running process)
+    void restartClock();
+
+    /// @brief Names the calling thread's lane in the trace
+    void setThreadName(const std::string& name);
+
+    /**
+     * @brief Writes the recorded spans as Chrome Trace Event JSON.
+     *
+     * The file can be loaded into Perfetto or chrome://tracing.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void writeTrace(const std::string& path);
+
+    /// @brief Formats the merged call tree of all threads
+    std::string formatSummary();
+
+    /// @brief Prints the summary to the console and the log file
+    void printSummary();
+
+private:
+    Profiler() = default;
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    /// @brief Histogram resolution: 8 sub-buckets per power of two (~12% error)
+    static constexpr int kSubBucketBits = 3;
+    static constexpr int kBucketCount = 64 << kSubBucketBits;
+
+    struct Node {
+        uint32_t site;
+        uint32_t parent;
+        uint32_t firstChild = UINT32_MAX;
+        uint32_t nextSibling = UINT32_MAX;
+        uint64_t count = 0;
+        uint64_t totalNs = 0;       ///< Inclusive time
+        uint64_t childNs = 0;       ///< Time spent in child scopes
+        uint64_t minNs = UINT64_MAX;
+        uint64_t maxNs = 0;
+        std::array<uint32_t, kBucketCount> histogram {};
+    };
+
+    /// @brief One recorded span (tracing only)
+    struct TraceEvent {
+        uint32_t site;
+        uint64_t startNs;
+        uint64_t durationNs;
+        std::string detail;
+    };
+
+    /// @brief Per-thread call tree; node 0 is an artificial root
+    struct ThreadProfile {
+        std::vector<Node> nodes;
+        uint32_t current = 0;
+        std::string name;
+        std::vector<TraceEvent> events;
+    };
+
+    /// @brief Merged view of the per-thread trees, used for reporting
+    struct SummaryNode;
+
+    ThreadProfile& threadProfile();
+
+    static int bucketOf(uint64_t ns);
+    static double bucketValueNs(int bucket);
+
+    std::mutex registryMutex;
+    std::vector<const ProfileSite*> sites;
+
+    std::mutex dynamicSiteMutex;
+    std::vector<std::unique_ptr<ProfileSite>> dynamicSites;
+    std::vector<std::unique_ptr<std::string>> dynamicNames;
+    std::vector<std::unique_ptr<ThreadProfile>> threads;     ///< Index 0 is the first (main) thread
+
+    std::atomic<bool> tracing {false};
+    uint64_t traceGranularityNs = 0;
+};
+
+/// @brief RAII helper that times one execution of a scope
+class ProfileScope {
+public:
+    explicit ProfileScope(const ProfileSite& site)
+        : node(Profiler::getInstance().enter(site)), startNs(Profiler::now()) {}
+
+    ProfileScope(const ProfileSite& site, std::string_view detail)
+        : node(Profiler::getInstance().enter(site)), startNs(Profiler::now()), detail(detail) {}
+
+    ~ProfileScope() {
+        Profiler::getInstance().leave(node, startNs, detail);
+    }
+
+    uint64_t getStartNs() const { return startNs; }
+
+private:
+    uint32_t node;
+    uint64_t startNs;
+    std::string_view detail;
+};
+
+#endif
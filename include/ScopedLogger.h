@@ -2,44 +2,55 @@
 #define SCOPED_LOGGER_H
 
 #include "Logger.h"
+#include "Profiler.h"
+#include <cstdio>
 #include <string>
-#include <chrono>
-#include <iomanip>
+#include <string_view>
 
+/**
+ * @brief Times a scope in the profiler and indents the log lines inside it.
+ *
+ * The [START] / [DONE ] lines are TRACE messages and are only formatted when
+ * TRACE is enabled for the console or the log file; otherwise a scope costs
+ * two clock reads and a call-tree lookup.
+ */
 class ScopedLogger {
 public:
-    ScopedLogger(const std::string& name, const std::string& file, int line) 
-        : scopeName(name), file(file), line(line) {
-        
-        // If indentation is 0 *before* we increase it, we are at root level
-        isRoot = (Logger::getInstance().getIndentation() == 0);
-        
-        Logger::getInstance().registerScopeStart(scopeName);
-        startTime = std::chrono::steady_clock::now();
-        Logger::getInstance().log(LogLevel::INFO, "[START] " + scopeName, file, line);
+    explicit ScopedLogger(const ProfileSite& site, std::string_view detail = {})
+        : site(site), profileScope(site, detail) {
+
+        if (Logger::getInstance().isEnabled(LogLevel::TRACE))
+            Logger::getInstance().log(LogLevel::TRACE, std::string("[START] ") + site.name, site.file, site.line);
         Logger::getInstance().increaseIndent();
     }
 
     ~ScopedLogger() {
         Logger::getInstance().decreaseIndent();
-        auto endTime = std::chrono::steady_clock::now();
-        double durationMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
-        
-        std::stringstream msg;
-        msg << "[DONE ] " << scopeName << " (" << std::fixed << std::setprecision(3) << durationMs << " ms)";
-        
-        Logger::getInstance().log(LogLevel::INFO, msg.str(), file, line);
-        Logger::getInstance().recordScopeDuration(scopeName, durationMs, isRoot);
+
+        if (Logger::getInstance().isEnabled(LogLevel::TRACE)) {
+            double durationMs = (Profiler::now() - profileScope.getStartNs()) / 1e6;
+            char duration[32];
+            std::snprintf(duration, sizeof(duration), " (%.3f ms)", durationMs);
+            Logger::getInstance().log(LogLevel::TRACE, std::string("[DONE ] ") + site.name + duration, site.file, site.line);
+        }
     }
 
 private:
-    std::string scopeName;
-    std::string file;
-    int line;
-    std::chrono::steady_clock::time_point startTime;
-    bool isRoot;
+    const ProfileSite& site;
+    ProfileScope profileScope;
 };
 
-#define LOG_SCOPE(name) ScopedLogger scopedLogger(name, __FILE__, __LINE__)
+#define PI_SCOPE_CONCAT_IMPL(a, b) a##b
+#define PI_SCOPE_CONCAT(a, b) PI_SCOPE_CONCAT_IMPL(a, b)
+
+/// @brief Profiles the enclosing scope; name must be a string literal
+#define LOG_SCOPE(name) \
+    static const ProfileSite PI_SCOPE_CONCAT(profileSite, __LINE__)(name, __FILE__, __LINE__); \
+    ScopedLogger scopedLogger(PI_SCOPE_CONCAT(profileSite, __LINE__))
+
+/// @brief Like LOG_SCOPE; detail (e.g. a function name) is attached to the span in the time trace
+#define LOG_SCOPE_DETAIL(name, detail) \
+    static const ProfileSite PI_SCOPE_CONCAT(profileSite, __LINE__)(name, __FILE__, __LINE__); \
+    ScopedLogger scopedLogger(PI_SCOPE_CONCAT(profileSite, __LINE__), detail)
 
 #endif // SCOPED_LOGGER_H
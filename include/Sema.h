@@ -0,0 +1,202 @@
+#ifndef SEMA_H
+#define SEMA_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <llvm/ADT/APSInt.h>
+
+#include "AST.h"
+#include "SourceManager.h"
+
+/**
+ * @brief Semantic analysis between parsing and code generation.
+ *
+ * Resolves names, annotates every expression node with its TypeId and
+ * reports semantic errors (unknown variables and functions, argument
+ * counts, assignments to immutable names, out-of-range constants, overflow
+ * and division by zero in constant expressions, return mismatches, misused
+ * arrays, slices and vectors, constant indices out of bounds) before any IR is
+ * built. Code generation relies on the annotations and performs no checks
+ * of its own.
+ *
+ * Constant expressions are evaluated here, in the width and signedness of
+ * the type each operation has, exactly as the generated code would compute
+ * them. Every expression whose operands are constant is replaced by a
+ * Constant node, and so is every use of a constant, so code generation
+ * emits plain LLVM constants for them.
+ *
+ * Every element access gets its bounds check decided here (see
+ * boundsChecks): constant indices into arrays and for loop variables whose
+ * range lies within the indexed array or slice need none, other accesses by
+ * a loop variable are checked once per loop.
+ */
+class Sema {
+public:
+
+    /**
+     * @brief Constructor.
+     *
+     * @param sourceManager The source the AST was parsed from (used for diagnostics).
+     * @param ast The program; expression nodes get their type field filled in.
+     * @param boundsChecks false elides all bounds checks (--no-bounds-checks).
+     */
+    Sema(const SourceManager& sourceManager, Ast& ast, bool boundsChecks = true);
+
+    /**
+     * @brief Analyzes all functions in source order.
+     *
+     * Indexes the functions by name first, so a call may precede its callee.
+     *
+     * @throws std::runtime_error with a located message for the first error.
+     */
+    void analyze();
+
+    /// @brief Analyzes a single function (see analyze(); the functions must be indexed)
+    void analyzeFunction(NodeId function);
+
+private:
+    const SourceManager& sourceManager;
+    Ast& ast;
+    TypeTable& typeTable;
+    bool boundsChecks;
+
+    /// @brief What is known about the values of a for loop variable
+    struct LoopRange {
+        std::optional<int64_t> first;   ///< The start, if it is a non-negative constant
+        std::optional<int64_t> end;     ///< The end, if it is a constant (0 if negative)
+        uint32_t lengthOf = 0;          ///< The id of the slice whose len() is the end (0: none)
+    };
+
+    /**
+     * @brief A name in scope: its declared type, whether it is a var and, if known at compile time, its value.
+     *
+     * Ids grow in declaration order, so a binding with a smaller id than a
+     * loop variable was declared before the loop.
+     */
+    struct Binding {
+        TypeId type;
+        std::optional<int64_t> value;
+        bool isMutable = false;
+        uint32_t id = 0;
+        std::optional<LoopRange> loop;  ///< Set for for loop variables
+    };
+
+    /// @brief The id of the last declared binding
+    uint32_t bindingCount = 0;
+
+    /// @brief Parameters, constants, variables and loop variables visible at the current statement
+    std::unordered_map<std::string_view, Binding> scope;
+
+    /// @brief Analyzes the statements of a function or loop body
+    void analyzeStatements(NodeRange statements, TypeId returnType);
+
+    /// @brief Analyzes a loop body; the names declared in it are only visible inside
+    void analyzeBlock(NodeRange statements, TypeId returnType);
+
+    void analyzeConst(const AstNode& constNode);
+    void analyzeVar(const AstNode& varNode);
+    void analyzeAssign(AstNode& assignNode);
+    void analyzeIndexAssign(AstNode& assignNode);
+    void analyzeFor(AstNode& forNode, TypeId returnType);
+    void analyzeReturn(const AstNode& returnNode, TypeId returnType);
+
+    /// @brief Resolves the type of a comparison (like a binary operation; the result is a condition)
+    void analyzeCondition(NodeId id);
+
+    /// @brief If the value is a constant, checks that it fits into the type it is converted to
+    void checkConstantFits(NodeId value, TypeId type) const;
+
+    /**
+     * @brief Resolves the type of an expression and stores it in the node.
+     *
+     * @param expected The type the value is converted to (kNoType if none); integer literals take it if their value fits,
+     *                 so constant expressions are folded in the declared width and signedness.
+     */
+    TypeId analyzeExpression(NodeId id, TypeId expected = kNoType);
+
+    /// @brief Like analyzeExpression, for expressions that must have a value (not a call of a void function)
+    TypeId analyzeValue(NodeId id, TypeId expected = kNoType);
+
+    /// @brief Like analyzeValue, for values that must not be vectors (loop bounds and comparisons)
+    TypeId analyzeScalarValue(NodeId id);
+
+    /**
+     * @brief Analyzes a value that is converted to a declared type (initializer, assigned or returned value, argument).
+     *
+     * Scalars convert to any scalar type and are splat to all lanes of a
+     * vector; a constant must fit into the (lane) type. A vector only
+     * converts to its own type, and an array literal gives a vector its lanes.
+     */
+    void analyzeConvertedValue(NodeId id, TypeId type);
+
+    /// @brief Resolves the callee of a call and checks the arguments against its parameters
+    void analyzeCall(AstNode& call);
+
+    /// @brief The binding of an indexed, sliced or measured name, which must be an array, slice or vector
+    const Binding& lookupAggregate(const AstNode& node) const;
+
+    /// @brief Resolves the element (lane) type and bounds check of an Index or IndexAssign node
+    void analyzeIndex(AstNode& access, const Binding& base);
+
+    /// @brief Resolves the type and bounds check of a Slice node
+    void analyzeSlice(AstNode& slice);
+
+    /**
+     * @brief Analyzes a value that initializes or is passed as a slice.
+     *
+     * A var array is converted to a slice of all of its elements (the
+     * Variable node gets the slice type).
+     */
+    void analyzeSliceValue(NodeId id, TypeId sliceType);
+
+    /// @brief Checks the initializer of an array (or the lanes of a vector), which must be an array literal with one value per element
+    void analyzeArrayLiteral(NodeId id, TypeId arrayType);
+
+    /// @brief Analyzes an index, which must have an integer type
+    void analyzeIndexValue(NodeId id);
+
+    /**
+     * @brief The bounds check an element access needs.
+     *
+     * @throws std::runtime_error if a constant index is outside of an array.
+     */
+    char decideBoundsCheck(const AstNode& access, const Binding& base) const;
+
+    /// @brief The type of an integer literal: the expected integer type if the value fits, else int64 (uint64 above INT64_MAX)
+    TypeId literalType(const AstNode& literal, TypeId expected) const;
+
+    /**
+     * @brief The type both operands of a binary operation are converted to.
+     *
+     * An integer literal takes the type of the other operand. Otherwise (also
+     * between two literals) the wider type wins; at equal width the unsigned one.
+     */
+    TypeId commonType(const AstNode& left, const AstNode& right) const;
+
+    /// @brief Whether the node is a literal or a folded constant
+    static bool isConstant(const AstNode& node);
+
+    /// @brief The value of a constant node in the bits of its type
+    llvm::APSInt constantValue(const AstNode& node) const;
+
+    /**
+     * @brief Converts the value of a constant node to another type.
+     *
+     * @throws std::runtime_error located at node if the value does not fit into the type.
+     */
+    llvm::APSInt convertConstant(const AstNode& node, TypeId type) const;
+
+    /**
+     * @brief Evaluates a binary operation on constant operands and turns the node into a Constant.
+     *
+     * @throws std::runtime_error on overflow or division by zero.
+     */
+    void foldBinaryOp(AstNode& node);
+
+    std::string formatError(const AstNode& node, const std::string& message) const;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef SOURCE_MANAGER_H
+#define SOURCE_MANAGER_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief 1-based line and column of a position in the source
+struct SourceLocation {
+    int line;
+    int column;
+};
+
+/**
+ * @brief Owns the source buffer of a single Pi translation unit.
+ *
+ * Tokens and AST nodes do not copy their spelling; they hold std::string_view
+ * slices into the buffer owned by this class. The SourceManager therefore has
+ * to outlive every token, AST node and diagnostic that refers to it.
+ *
+ * Files are memory-mapped rather than read, so the source text exists in
+ * memory exactly once no matter how large the input is.
+ */
+class SourceManager {
+public:
+
+    /**
+     * @brief Constructor.
+     *
+     * @param fileName Name of the file the source was read from (used in diagnostics).
+     * @param source The source text. Ownership is taken over.
+     */
+    SourceManager(std::string fileName, std::string source);
+
+    ~SourceManager();
+
+    /**
+     * @brief Loads a source file without copying it.
+     *
+     * Regular files are mapped read-only into memory. The path "-" reads from
+     * standard input; if stdin is redirected from a regular file it is mapped
+     * as well, otherwise it is read into a single growing buffer.
+     *
+     * @param path The path of the file to load, or "-" for standard input.
+     * @return The source manager owning the loaded text.
+     * @throws std::runtime_error if the file cannot be opened or read.
+     */
+    static std::unique_ptr<SourceManager> loadFile(const std::string& path);
+
+    // Views into the buffer must stay valid, so the buffer never moves
+    SourceManager(const SourceManager&) = delete;
+    SourceManager& operator=(const SourceManager&) = delete;
+
+    /// @brief The complete source text
+    std::string_view getBuffer() const;
+
+    /// @brief The name of the file the source was read from
+    const std::string& getFileName() const;
+
+    /**
+     * @brief Resolves a byte offset into line and column.
+     *
+     * Tokens only store their offset. The table of line starts is built on
+     * the first call (a single bulk scan for newlines), after that each lookup
+     * is a binary search. Only diagnostics need this, so a successful compile
+     * never pays for it. Safe to call from several threads.
+     *
+     * @param offset Byte offset into the buffer (the buffer size denotes the end of file).
+     * @return The 1-based line and column.
+     */
+    SourceLocation getLocation(uint32_t offset) const;
+
+    /**
+     * @brief Formats a diagnostic that points into this source.
+     *
+     * @param offset Byte offset the diagnostic refers to.
+     * @param message The error message.
+     * @return "Error: [<file>, Line L, Col C] <message>"
+     */
+    std::string formatError(uint32_t offset, const std::string& message) const;
+
+private:
+    SourceManager(std::string fileName);
+
+    /// @brief Maps or reads the open file descriptor fd into this source manager
+    void loadFromDescriptor(int fd);
+
+    std::string fileName;
+    std::string ownedBuffer;            ///< Backing storage for sources that are not mapped
+    void* mappedData = nullptr;         ///< Start of the read-only mapping (if mapped)
+    size_t mappedSize = 0;              ///< Length of the mapping in bytes
+    std::string_view buffer;            ///< The source text (points into ownedBuffer or the mapping)
+
+    /// @brief Offsets at which a line starts (built lazily by getLocation)
+    mutable std::vector<uint32_t> lineStarts;
+    mutable std::once_flag lineStartsBuilt;
+};
+
+#endif
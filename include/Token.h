@@ -1,11 +1,14 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 enum TokenType {
 
     TOKEN_FUNC,     // function
+    TOKEN_EXPORT,   // exported function (visible outside the module)
     TOKEN_RETURN,   // return
     TOKEN_VOID,     // void return type
 
@@ -13,6 +16,12 @@ enum TokenType {
     TOKEN_IDENT,    // function identifier
     TOKEN_PRINT,    // print function (provisional)
     TOKEN_CONST,    // constant
+    TOKEN_VAR,      // mutable variable
+    TOKEN_WHILE,    // while loop
+    TOKEN_FOR,      // counted for loop
+    TOKEN_IN,       // separates the loop variable from the range of a for loop
+    TOKEN_LEN,      // len(<array or slice>)
+    TOKEN_REDUCE,   // reduce(<operator>, <vector>)
 
     TOKEN_LPAREN,   // (
     TOKEN_RPAREN,   // )
@@ -20,15 +29,27 @@ enum TokenType {
     TOKEN_LBRACE,   // {
     TOKEN_RBRACE,   // }
 
+    TOKEN_LBRACKET, // [
+    TOKEN_RBRACKET, // ]
+
     TOKEN_COLON,    // :
+    TOKEN_COMMA,    // , (separates parameters and arguments)
     TOKEN_ASSIGN,   // =
     TOKEN_ARROW,    // indicate a return type of a function
+    TOKEN_DOTDOT,   // .. (range of a for loop)
 
     TOKEN_PLUS,     // +
     TOKEN_MINUS,    // -
     TOKEN_STAR,     // *
     TOKEN_SLASH,    // /
 
+    TOKEN_EQUAL,            // ==
+    TOKEN_NOT_EQUAL,        // !=
+    TOKEN_LESS,             // <
+    TOKEN_LESS_EQUAL,       // <=
+    TOKEN_GREATER,          // >
+    TOKEN_GREATER_EQUAL,    // >=
+
     // CHARACTER TYPES
 
     TOKEN_CHAR8,
@@ -62,9 +83,8 @@ std::string TokenTypeToString(TokenType tokenType);
 
 struct Token {
     TokenType type;
-    std::string lexeme;
-    int line;               // Line number where the token was found
-    int column;             // Column number where the token was found
+    std::string_view lexeme;    // Slice of the SourceManager buffer
+    uint32_t offset;            // Byte offset of the token start (see SourceManager::getLocation)
 };
 
 #endif
\ No newline at end of file
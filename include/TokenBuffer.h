@@ -0,0 +1,81 @@
+#ifndef TOKEN_BUFFER_H
+#define TOKEN_BUFFER_H
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "Token.h"
+#include "TokenStream.h"
+
+static_assert(TOKEN_UNKNOWN <= std::numeric_limits<uint8_t>::max(), "Token kinds must fit into a byte");
+
+/**
+ * @brief Compact structure-of-arrays storage for a complete token stream.
+ *
+ * Each token takes 9 bytes: its kind, the offset of its first character and
+ * the length of its spelling in the source (including quotes of literals).
+ * The lexeme is derived from the source on access and line/column are only
+ * computed when a diagnostic asks the SourceManager for them. The parallel
+ * arrays keep a sequential scan over millions of tokens cache-friendly.
+ */
+class TokenBuffer {
+public:
+
+    /// @param source The source the tokens were scanned from (not owned).
+    TokenBuffer(std::string_view source) : source(source) {}
+
+    /// @brief Appends a token that spans [offset, offset + length) in the source
+    void push(TokenType type, uint32_t offset, uint32_t length) {
+        kinds.push_back(static_cast<uint8_t>(type));
+        offsets.push_back(offset);
+        lengths.push_back(length);
+    }
+
+    void reserve(size_t count) {
+        kinds.reserve(count);
+        offsets.reserve(count);
+        lengths.reserve(count);
+    }
+
+    size_t size() const { return kinds.size(); }
+
+    TokenType kind(size_t index) const { return static_cast<TokenType>(kinds[index]); }
+    uint32_t offset(size_t index) const { return offsets[index]; }
+
+    /// @brief The token's text as written in the source (literals with their quotes)
+    std::string_view spelling(size_t index) const { return source.substr(offsets[index], lengths[index]); }
+
+    /// @brief Rebuilds the token at index
+    Token get(size_t index) const;
+
+private:
+    std::string_view source;
+    std::vector<uint8_t> kinds;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+};
+
+/**
+ * @brief Token source over a range of a TokenBuffer.
+ *
+ * This is the eager mode for tools that tokenize the whole input first
+ * (e.g. with Lexer::tokenize()). The range end acts as end of file.
+ */
+class TokenBufferSource : public TokenSource {
+public:
+    TokenBufferSource(const TokenBuffer& buffer, size_t begin, size_t end)
+        : buffer(buffer), index(begin), end(end) {}
+
+    TokenBufferSource(const TokenBuffer& buffer) : TokenBufferSource(buffer, 0, buffer.size()) {}
+
+    Token next() override;
+
+private:
+    const TokenBuffer& buffer;
+    size_t index;
+    size_t end;
+};
+
+#endif
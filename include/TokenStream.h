@@ -0,0 +1,20 @@
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+#include "Token.h"
+
+/**
+ * @brief A source of tokens that the parser pulls from on demand.
+ *
+ * Implementations must return TOKEN_EOF once they are exhausted and keep
+ * returning it on every further call.
+ */
+class TokenSource {
+public:
+    virtual ~TokenSource() = default;
+
+    /// @brief Produces the next token
+    virtual Token next() = 0;
+};
+
+#endif
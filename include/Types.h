@@ -0,0 +1,110 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/// @brief Index of a type in the TypeTable; equal ids mean equal types
+using TypeId = uint16_t;
+
+/// @brief Marks a node whose type has not been resolved (yet)
+constexpr TypeId kNoType = UINT16_MAX;
+
+enum class TypeKind : uint8_t {
+    Void,
+    Integer,
+    Char,
+    Array,          ///< [N]T: N elements of a scalar type, stored contiguously
+    Slice,          ///< []T: a pointer to elements of a scalar type and their count
+    Vector          ///< vecN<T>: N lanes of an integer type, one SIMD value
+};
+
+/// @brief Resolved description of a type
+struct TypeInfo {
+    TypeKind kind = TypeKind::Void;
+    uint8_t bits = 0;           ///< Width of integer and character types
+    bool isSigned = false;      ///< Vectors: whether their lanes are
+    std::string name;           ///< Spelling used in diagnostics
+    TypeId element = kNoType;   ///< Element type of arrays, slices and vectors
+    uint64_t length = 0;        ///< Number of elements of an array, lanes of a vector
+
+    bool isVoid() const { return kind == TypeKind::Void; }
+
+    /// @brief Whether values of the type are sequences of elements (arrays and slices)
+    bool isAggregate() const { return kind == TypeKind::Array || kind == TypeKind::Slice; }
+
+    bool isVector() const { return kind == TypeKind::Vector; }
+};
+
+/// @brief Ids of the built-in types (registered in this order by the TypeTable)
+namespace types {
+    constexpr TypeId Void   = 0;
+    constexpr TypeId Int8   = 1;
+    constexpr TypeId Int16  = 2;
+    constexpr TypeId Int32  = 3;
+    constexpr TypeId Int64  = 4;
+    constexpr TypeId Uint8  = 5;
+    constexpr TypeId Uint16 = 6;
+    constexpr TypeId Uint32 = 7;
+    constexpr TypeId Uint64 = 8;
+    constexpr TypeId Char8  = 9;
+    constexpr TypeId Char16 = 10;
+    constexpr TypeId Char32 = 11;
+}
+
+/**
+ * @brief Process-wide table of interned types.
+ *
+ * Every distinct type is stored once and referred to by a 16-bit TypeId, so
+ * later passes compare types with integer compares. The built-in types have
+ * fixed ids (see the types namespace). Entries never move: lookups need no
+ * lock, only interning a new type does.
+ */
+class TypeTable {
+public:
+    static TypeTable& getInstance();
+
+    /// @brief The description of a type (valid for the lifetime of the program)
+    const TypeInfo& get(TypeId id) const {
+        return chunks[id >> kChunkBits][id & (kChunkSize - 1)];
+    }
+
+    /**
+     * @brief Returns the id of a type, adding it to the table on first use.
+     *
+     * @throws std::runtime_error if the table is full.
+     */
+    TypeId intern(const TypeInfo& info);
+
+    /// @brief The type [length]element (interned on first use)
+    TypeId getArray(TypeId element, uint64_t length);
+
+    /// @brief The type []element (interned on first use)
+    TypeId getSlice(TypeId element);
+
+    /// @brief The type vecN<element> with N = lanes (interned on first use)
+    TypeId getVector(TypeId element, uint64_t lanes);
+
+    bool isSigned(TypeId id) const { return get(id).isSigned; }
+    const std::string& getName(TypeId id) const { return get(id).name; }
+
+private:
+    TypeTable();
+
+    TypeTable(const TypeTable&) = delete;
+    TypeTable& operator=(const TypeTable&) = delete;
+
+    static constexpr int kChunkBits = 8;
+    static constexpr size_t kChunkSize = size_t(1) << kChunkBits;
+
+    /// @brief Fixed array of lazily allocated chunks, so existing entries never move
+    std::array<std::unique_ptr<TypeInfo[]>, (size_t(1) << 16) / kChunkSize> chunks;
+    std::atomic<size_t> count {0};
+    std::mutex internMutex;
+};
+
+#endif
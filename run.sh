@@ -17,8 +17,8 @@ cmake -DCMAKE_OSX_SYSROOT=/Library/Developer/CommandLineTools/SDKs/MacOSX15.4.sd
 # Build the project
 cmake --build .
 
-# Compiler the given .pi file to LLVM IR
-./picc ../examples/const.pi > const.ll
+# Compile the given .pi file to an optimized native executable
+./picc -O2 -o const ../examples/const.pi
 
-# Run the generated LLVM IR
-lli const.ll
\ No newline at end of file
+# Run it
+./const
\ No newline at end of file
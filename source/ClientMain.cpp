@@ -0,0 +1,62 @@
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../include/CompileServer.h"
+
+/**
+ * picc-client: runs a picc command line on a compile server (picc --server).
+ *
+ * The client does not link LLVM. Most of a cold picc start is spent in
+ * LLVM's static initializers, so this executable starts in a fraction of
+ * that time, while picc --client pays it like any other picc run. Without a
+ * server the command line is executed by the picc next to this executable.
+ */
+int main(int argc, char **argv) {
+    std::string socketPath;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--socket=", 0) == 0)
+            socketPath = arg.substr(std::string("--socket=").size());
+        else
+            args.push_back(arg);
+    }
+    if (socketPath.empty())
+        socketPath = CompileServer::defaultSocketPath();
+
+    try {
+        std::optional<int> status = CompileServer::request(socketPath, args);
+        if (status)
+            return *status;
+    } catch (const std::runtime_error &e) {
+        std::cerr << "Compile server error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // No server: the compiler itself takes over (same arguments, same descriptors)
+    std::vector<char*> compilerArgs { const_cast<char*>("picc") };
+    for (std::string& arg : args) {
+        compilerArgs.push_back(arg.data());
+    }
+    compilerArgs.push_back(nullptr);
+
+    char self[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (length > 0) {
+        std::string path(self, static_cast<size_t>(length));
+        std::string sibling = path.substr(0, path.rfind('/') + 1) + "picc";
+        execv(sibling.c_str(), compilerArgs.data());
+    }
+    execvp("picc", compilerArgs.data());
+
+    std::cerr << "Cannot run picc: " << std::strerror(errno) << std::endl;
+    return 1;
+}
@@ -1,85 +1,147 @@
 #include "../include/Codegen.h"
 #include "../include/Logger.h"
-#include "../include/Token.h"
+#include "../include/ScopedLogger.h"
 
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <unordered_set>
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/ThreadPool.h>
 
 using namespace llvm;
 
-static std::string formatError(const Token& token, const std::string& message) {
-    return "Error: [Line " + std::to_string(token.line) + ", Col " + std::to_string(token.column) + "] " + message;
+void Codegen::initializeTargets() {
+    static std::once_flag initialized;
+    std::call_once(initialized, [] () {
+        InitializeNativeTarget();
+        InitializeNativeTargetAsmPrinter();
+        InitializeNativeTargetAsmParser();
+    });
 }
 
-Codegen::Codegen() : module(std::make_unique<Module>("MyLangModule", context)), builder(context) {
+Codegen::Codegen(const SourceManager& sourceManager, const Ast& ast)
+    : sourceManager(sourceManager), ast(ast), typeTable(TypeTable::getInstance()),
+      context(std::make_unique<LLVMContext>()), module(std::make_unique<Module>("MyLangModule", *context)), builder(*context) {
 
     LOG_INFO("Initializing CodeGen with new LLVM module");
 
-    // Initialize LLVM native targets
-    InitializeNativeTarget();
-    InitializeNativeTargetAsmPrinter();
-    InitializeNativeTargetAsmParser();
+    // Initialize LLVM native targets (once per process)
+    initializeTargets();
+
+    declarePuts();
+
+}
 
-    // Declare the C function puts
-    std::vector<Type*> putsArgs { Type::getInt8Ty(context)->getPointerTo() };
+void Codegen::declarePuts() {
+    std::vector<Type*> putsArgs { Type::getInt8Ty(*context)->getPointerTo() };
     FunctionType *putsType = FunctionType::get(builder.getInt32Ty(), putsArgs, false);
     putsFunc = module->getOrInsertFunction("puts", putsType);
+}
 
+llvm::Type* Codegen::getLLVMType(TypeId type) {
+    const TypeInfo& info = typeTable.get(type);
+    switch (info.kind) {
+        case TypeKind::Void:
+            return builder.getVoidTy();
+        case TypeKind::Array:
+            return ArrayType::get(getLLVMType(info.element), info.length);
+        case TypeKind::Slice:
+            return StructType::get(*context, { getLLVMType(info.element)->getPointerTo(), builder.getInt64Ty() });
+        case TypeKind::Vector:
+            return FixedVectorType::get(getLLVMType(info.element), static_cast<unsigned>(info.length));
+        default:
+            return builder.getIntNTy(info.bits);
+    }
 }
 
-llvm::Type* Codegen::getReturnType(const std::string &retTypeStr) {
+llvm::Value* Codegen::convert(llvm::Value* value, TypeId from, TypeId to) {
+    llvm::Type* target = getLLVMType(to);
+    if (value->getType() == target)
+        return value;
 
-    if(retTypeStr == "char8" || retTypeStr == "int8" || retTypeStr == "uint8")
-        return builder.getInt8Ty();
-    else if(retTypeStr == "char16" || retTypeStr == "int16" || retTypeStr == "uint16")
-        return builder.getInt16Ty();
-    else if(retTypeStr == "char32" || retTypeStr == "int32" || retTypeStr == "uint32")
-        return builder.getInt32Ty();
-    else if(retTypeStr == "int64" || retTypeStr == "uint64")
-        return builder.getInt64Ty();
-    else if(retTypeStr == "void")
-        return builder.getVoidTy();
-    
-    throw std::runtime_error("Unsupported return type: " + retTypeStr);
+    // Sema only converts scalars to vectors, never vectors
+    if (auto* vectorType = dyn_cast<FixedVectorType>(target)) {
+        llvm::Value* lane = builder.CreateIntCast(value, vectorType->getElementType(), typeTable.isSigned(from), "casttmp");
+        return builder.CreateVectorSplat(vectorType->getNumElements(), lane, "splat");
+    }
+    return builder.CreateIntCast(value, target, typeTable.isSigned(from), "casttmp");
+}
+
+std::string Codegen::formatError(const AstNode& node, const std::string& message) const {
+    return sourceManager.formatError(node.offset, message);
+}
 
+bool Codegen::isInternal(const AstNode& function) {
+    return !function.isExported() && function.name != "main";
 }
 
-bool Codegen::isUnsignedType(const std::string &typeStr) {
-    if (typeStr.find("uint") == 0) return true;
-    return false;
+llvm::Function* Codegen::createFunction(const AstNode& function) {
+    std::vector<llvm::Type*> paramTypes;
+    for (NodeId param : ast.parameters(function)) {
+        paramTypes.push_back(getLLVMType(ast.get(param).type));
+    }
+    FunctionType* funcType = FunctionType::get(getLLVMType(function.type), paramTypes, false);
 
+    // External until the module is complete (see internalizeFunctions), so that separately
+    // generated modules can refer to each other
+    Function* func = Function::Create(funcType, Function::ExternalLinkage, function.name, module.get());
+    if (isInternal(function))
+        func->setCallingConv(CallingConv::Fast);
+    return func;
 }
 
-void Codegen::generateCode(const FuncNode* funcAST) {
+llvm::Function* Codegen::declareFunction(NodeId function) {
+    const AstNode& node = ast.get(function);
+    if (Function* existing = module->getFunction(node.name))
+        return existing;
+    return createFunction(node);
+}
 
-    // Determine the LLVM type for the return type of the function
-    llvm::Type* retType = nullptr;
-    try {
-        retType = getReturnType(funcAST->returnType);
-    } catch (const std::exception& e) {
-        throw std::runtime_error(formatError(funcAST->token, e.what()));
+void Codegen::internalizeFunctions(const std::vector<NodeId>& functions) {
+    for (NodeId function : functions) {
+        const AstNode& node = ast.get(function);
+        if (!isInternal(node))
+            continue;
+        Function* func = module->getFunction(node.name);
+        if (func && !func->isDeclaration())
+            func->setLinkage(Function::InternalLinkage);
     }
+}
 
-    // Create the functionC signature
-    FunctionType* funcType = FunctionType::get(retType, false);
-    Function* func = Function::Create(funcType, Function::ExternalLinkage, funcAST->name, module.get());
-    BasicBlock* funcBB = BasicBlock::Create(context, "entry", func);
+void Codegen::generateCode(NodeId function) {
+    const AstNode& funcAST = ast.get(function);
+    LOG_SCOPE_DETAIL("Codegen Function", funcAST.name);
+
+    // Determine the LLVM type for the return type of the function
+    llvm::Type* retType = getLLVMType(funcAST.type);
+
+    // A call may have declared the function already; a second function of the same name is renamed by LLVM
+    Function* func = module->getFunction(funcAST.name);
+    if (!func || !func->isDeclaration())
+        func = createFunction(funcAST);
+    BasicBlock* funcBB = BasicBlock::Create(*context, "entry", func);
     builder.SetInsertPoint(funcBB);
 
-    // clear the symbol table for the new function scope
+    // clear the symbol table for the new function scope; the parameters are the first names in it
     namedValues.clear();
-    isUnsignedVar.clear();
-
-    // Here we treat a series of print statements as a function body
-    for (const auto& stmt : funcAST->body) {
-        if (auto printNode = dynamic_cast<const PrintNode*>(stmt.get())) {
-            generatePrint(printNode);
-        } else if (auto constNode = dynamic_cast<const ConstNode*>(stmt.get())) {
-            generateConst(constNode);
-        } else if (auto returnNode = dynamic_cast<const ReturnNode*>(stmt.get())) {
-            generateReturn(returnNode, retType, isUnsignedType(funcAST->returnType));
-        }
+    uncheckedLoops.clear();
+    boundsFailBlock = nullptr;
+    NodeRange params = ast.parameters(funcAST);
+    for (size_t i = 0; i < params.size(); ++i) {
+        llvm::Argument* arg = func->getArg(static_cast<unsigned>(i));
+        arg->setName(ast.get(params.begin()[i]).name);
+        namedValues[ast.get(params.begin()[i]).name] = arg;
     }
 
+    generateStatements(ast.body(funcAST), funcAST.type, true);
+
     // Return: 0 as default value if no return encountered (implicit void return at end)
     // Note: If the last statement was a return, this might be unreachable, but LLVM handles it.
     if (!builder.GetInsertBlock()->getTerminator()) {
@@ -89,143 +151,959 @@ void Codegen::generateCode(const FuncNode* funcAST) {
             builder.CreateRet(ConstantInt::get(retType, 0));
         }
     }
+
+    // The shared failure block of the bounds checks goes last
+    if (boundsFailBlock) {
+        func->getBasicBlockList().push_back(boundsFailBlock);
+        generateBoundsFail();
+    }
     verifyFunction(*func);
     
 }
 
-void Codegen::generateReturn(const ReturnNode* returnNode, llvm::Type* expectedRetType, bool isUnsigned) {
-    if (!returnNode->returnValue) {
-        if (!expectedRetType->isVoidTy())
-            throw std::runtime_error(formatError(returnNode->token, "Function must return a value"));
-        builder.CreateRetVoid();
-        return;
+void Codegen::generateStatements(NodeRange statements, TypeId returnType, bool isFunctionBody) {
+    for (const NodeId* stmt = statements.begin(); stmt != statements.end(); ++stmt) {
+
+        // Nothing after a return is reachable
+        if (builder.GetInsertBlock()->getTerminator())
+            break;
+
+        const AstNode& node = ast.get(*stmt);
+        switch (node.kind) {
+            case NodeKind::Print:
+                generatePrint(node);
+                break;
+            case NodeKind::Const:
+                generateConst(node);
+                break;
+            case NodeKind::Var:
+                generateVar(node);
+                break;
+            case NodeKind::Assign:
+                generateAssign(node);
+                break;
+            case NodeKind::IndexAssign:
+                generateIndexAssign(node);
+                break;
+            case NodeKind::While:
+                generateWhile(node, returnType);
+                break;
+            case NodeKind::For:
+                generateFor(node, returnType);
+                break;
+            case NodeKind::Return:
+                generateReturn(node, returnType);
+                break;
+            case NodeKind::Call: {
+                // Followed by the end of a void function, the call is in tail position
+                llvm::Value* call = generateExpression(*stmt);
+                const NodeId* next = stmt + 1;
+                bool returnsNext = next == statements.end()
+                    ? isFunctionBody && typeTable.get(returnType).isVoid()
+                    : ast.get(*next).kind == NodeKind::Return && ast.get(*next).value() == kNoNode;
+                if (returnsNext && canTailCall(ast.get(*stmt)))
+                    cast<CallInst>(call)->setTailCall();
+                break;
+            }
+            default:
+                break;
+        }
     }
+}
 
-    if (expectedRetType->isVoidTy())
-        throw std::runtime_error(formatError(returnNode->token, "Void function cannot return a value"));
+bool Codegen::hasUniqueNames(const std::vector<NodeId>& functions) const {
+    std::unordered_set<std::string_view> names;
+    for (NodeId function : functions) {
+        if (!names.insert(ast.get(function).name).second)
+            return false;
+    }
+    return true;
+}
 
-    llvm::Value* retVal = generateExpression(returnNode->returnValue.get()).first;
+void Codegen::generateFunctions(const std::vector<NodeId>& functions, unsigned jobs) {
 
-    if (retVal->getType() != expectedRetType) {
-        // Simple implicit cast attempt
-        if (expectedRetType->isIntegerTy() && retVal->getType()->isIntegerTy()) {
-            retVal = builder.CreateIntCast(retVal, expectedRetType, !isUnsigned, "casttmp");
-        } else {
-             throw std::runtime_error(formatError(returnNode->token, "Return type mismatch"));
+    // Functions with the same name are renamed in creation order by LLVM,
+    // which separate modules cannot reproduce; such programs are generated serially
+    if (jobs <= 1 || functions.size() < 2 || !hasUniqueNames(functions)) {
+        for (NodeId function : functions) {
+            generateCode(function);
         }
+    } else {
+        generateInParallel(functions, jobs);
     }
 
-    builder.CreateRet(retVal);
+    internalizeFunctions(functions);
 }
 
-std::pair<llvm::Value*, bool> Codegen::generateExpression(const ASTNode* node) {
-    if (auto numberNode = dynamic_cast<const NumberNode*>(node)) {
-        return {llvm::ConstantInt::get(builder.getInt64Ty(), numberNode->value), false};
+void Codegen::generateInParallel(const std::vector<NodeId>& functions, unsigned jobs) {
+
+    // A few groups per thread even out functions of different size; every group
+    // pays for one context and one bitcode round trip
+    size_t groupCount = std::min(functions.size(), static_cast<size_t>(jobs) * 4);
+    std::vector<SmallVector<char, 0>> bitcode(groupCount);
+    std::vector<std::exception_ptr> errors(groupCount);
+
+    LOG_DEBUG("Generating " + std::to_string(functions.size()) + " functions in " +
+              std::to_string(groupCount) + " groups on " + std::to_string(jobs) + " threads");
+    {
+        ThreadPool pool(hardware_concurrency(jobs));
+        for (size_t group = 0; group < groupCount; ++group) {
+            pool.async([this, &functions, &bitcode, &errors, group, groupCount] () {
+                Profiler::getInstance().setThreadName("codegen worker");
+                try {
+                    size_t begin = functions.size() * group / groupCount;
+                    size_t end = functions.size() * (group + 1) / groupCount;
+
+                    Codegen worker(sourceManager, ast);
+                    for (size_t i = begin; i < end; ++i) {
+                        worker.generateCode(functions[i]);
+                    }
+
+                    raw_svector_ostream out(bitcode[group]);
+                    WriteBitcodeToFile(*worker.module, out, true);
+                } catch (...) {
+                    errors[group] = std::current_exception();
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    // Report the error of the earliest function, like a serial run would
+    for (const std::exception_ptr& error : errors) {
+        if (error) std::rethrow_exception(error);
     }
-    else if (auto charNode = dynamic_cast<const CharNode*>(node)) {
-        return {llvm::ConstantInt::get(builder.getInt8Ty(), charNode->value), false};
+
+    LOG_SCOPE("Link Modules");
+    Linker linker(*module);
+    for (size_t group = 0; group < groupCount; ++group) {
+        MemoryBufferRef buffer(StringRef(bitcode[group].data(), bitcode[group].size()), "group");
+        Expected<std::unique_ptr<Module>> groupModule = parseBitcodeFile(buffer, *context);
+        if (!groupModule)
+            throw std::runtime_error("Cannot read generated bitcode: " + toString(groupModule.takeError()));
+
+        if (linker.linkInModule(std::move(*groupModule)))
+            throw std::runtime_error("Cannot link generated module");
+
+        bitcode[group] = {};
     }
-    else if (auto variableNode = dynamic_cast<const VariableNode*>(node)) {
-        llvm::AllocaInst* alloca = namedValues[variableNode->name];
-        if (!alloca) {
-             throw std::runtime_error(formatError(variableNode->token, "Unknown variable: " + variableNode->name));
-        }
-        bool isUnsigned = isUnsignedVar[variableNode->name];
-        return {builder.CreateLoad(alloca->getAllocatedType(), alloca, variableNode->name.c_str()), isUnsigned};
-    }
-    else if (auto binaryNode = dynamic_cast<const BinaryOpNode*>(node)) {
-        auto leftResult = generateExpression(binaryNode->left.get());
-        auto rightResult = generateExpression(binaryNode->right.get());
-        
-        llvm::Value* left = leftResult.first;
-        llvm::Value* right = rightResult.first;
-        
-        bool isUnsigned = leftResult.second || rightResult.second;
-
-        if (binaryNode->op == "+")
-            return {builder.CreateAdd(left, right, "addtmp"), isUnsigned};
-        if (binaryNode->op == "-")
-            return {builder.CreateSub(left, right, "subtmp"), isUnsigned};
-        if (binaryNode->op == "*")
-            return {builder.CreateMul(left, right, "multmp"), isUnsigned};
-        if (binaryNode->op == "/") {
-            // Check for division by literal zero
-            if (auto numNode = dynamic_cast<const NumberNode*>(binaryNode->right.get())) {
-                if (numNode->value == 0) {
-                     throw std::runtime_error(formatError(binaryNode->token, "Division by zero"));
+
+    renameStringConstants();
+}
+
+bool Codegen::generateIncremental(const std::vector<NodeId>& functions, const std::vector<std::string>& keys,
+                                   CompileCache& store, Optimizer& optimizer) {
+
+    // As in generateInParallel, separately generated duplicates could not be renamed like a serial run
+    if (keys.size() != functions.size() || !hasUniqueNames(functions)) {
+        generateFunctions(functions, 1);
+        return false;
+    }
+
+    size_t reused = 0;
+    for (size_t i = 0; i < functions.size(); ++i) {
+        std::unique_ptr<Module> part;
+
+        // A stored function is read into this context; an unreadable entry is regenerated
+        std::string entry = store.lookup(keys[i]);
+        if (!entry.empty()) {
+            LOG_SCOPE_DETAIL("Load Function", ast.get(functions[i]).name);
+            ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(entry);
+            if (buffer) {
+                Expected<std::unique_ptr<Module>> stored = parseBitcodeFile((*buffer)->getMemBufferRef(), *context);
+                if (stored) {
+                    part = std::move(*stored);
+                    reused++;
+                } else {
+                    LOG_WARNING("Ignoring unreadable function entry " + entry + ": " + toString(stored.takeError()));
                 }
             }
+        }
 
-            if (isUnsigned)
-                return {builder.CreateUDiv(left, right, "divtmp"), true};
-            else
-                return {builder.CreateSDiv(left, right, "divtmp"), false};
+        if (!part) {
+            part = generateIsolated(functions[i]);
+            optimizer.run(*part);
+
+            // Reading bitcode gives intrinsics their own attributes again (the optimizer adds e.g.
+            // mustprogress to llvm.vector.reduce.*), so a new function is stored as it is read back
+            for (Function& function : *part) {
+                if (function.isIntrinsic())
+                    function.setAttributes(Intrinsic::getAttributes(*context, function.getIntrinsicID()));
+            }
+
+            // With the use-list order a stored function prints exactly like a new one (e.g. "; preds = ")
+            SmallVector<char, 0> bitcode;
+            raw_svector_ostream out(bitcode);
+            WriteBitcodeToFile(*part, out, true);
+            store.store(keys[i], std::string_view(bitcode.data(), bitcode.size()));
         }
-        
-        throw std::runtime_error(formatError(binaryNode->token, "Unknown binary operator: " + binaryNode->op));
+
+        spliceModule(std::move(part));
     }
-    
-    throw std::runtime_error(formatError(node->token, "Unknown expression node type"));
+
+    renameStringConstants();
+    internalizeFunctions(functions);
+
+    LOG_INFO("Incremental code generation: reused " + std::to_string(reused) + " of " +
+             std::to_string(functions.size()) + " functions");
+    return true;
 }
 
-void Codegen::generateConst(const ConstNode* constNode) {
+void Codegen::spliceModule(std::unique_ptr<Module> part) {
+
+    // Optimized parts carry the host target
+    if (module->getTargetTriple().empty() && !part->getTargetTriple().empty()) {
+        module->setTargetTriple(part->getTargetTriple());
+        module->setDataLayout(part->getDataLayout());
+    }
 
-    // Determine the corresponding LLVM type for the constant
-    llvm::Type* llvmType = nullptr;
+    // Private string constants keep clashing names for now; renameStringConstants fixes them
+    while (!part->global_empty()) {
+        GlobalVariable* global = &*part->global_begin();
+        global->removeFromParent();
+        module->getGlobalList().push_back(global);
+    }
+
+    // Declarations are merged with this module's symbols, definitions replace declarations
+    for (auto it = part->begin(); it != part->end(); ) {
+        Function* function = &*it++;
+        Function* existing = module->getFunction(function->getName());
+
+        if (existing && function->isDeclaration()) {
+            function->replaceAllUsesWith(ConstantExpr::getBitCast(existing, function->getType()));
+            function->eraseFromParent();
+            continue;
+        }
+        if (existing && existing->isDeclaration()) {
+            std::string name = existing->getName().str();
+            existing->replaceAllUsesWith(ConstantExpr::getBitCast(function, existing->getType()));
+            existing->eraseFromParent();
+            function->removeFromParent();
+            module->getFunctionList().push_back(function);
+            function->setName(name);
+            continue;
+        }
+
+        function->removeFromParent();
+        module->getFunctionList().push_back(function);
+    }
+}
+
+std::unique_ptr<Module> Codegen::generateIsolated(NodeId function) {
+    std::unique_ptr<Module> part = std::make_unique<Module>("MyLangModule", *context);
+    FunctionCallee puts = putsFunc;
+
+    std::swap(module, part);
+    declarePuts();
     try {
-        llvmType = getReturnType(constNode->type);
-    } catch (const std::exception& e) {
-        throw std::runtime_error(formatError(constNode->token, e.what()));
-    }
-
-    // Create a local variable (allocaInst)
-    llvm::AllocaInst* allocaInst = builder.CreateAlloca(llvmType, nullptr, constNode->name);
-
-    // [Semantic Check] Constant range check for integer literals
-    if (auto numNode = dynamic_cast<const NumberNode*>(constNode->value.get())) {
-        int64_t val = numNode->value;
-        std::string type = constNode->type;
-
-        if (type == "int8") {
-            if (val < -128 || val > 127) throw std::runtime_error(formatError(numNode->token, "Constant value out of range (int8)"));
-        } else if (type == "uint8") {
-            if (val < 0 || val > 255) throw std::runtime_error(formatError(numNode->token, "Constant value out of range (uint8)"));
-        } else if (type == "int16") {
-            if (val < -32768 || val > 32767) throw std::runtime_error(formatError(numNode->token, "Constant value out of range (int16)"));
-        } else if (type == "uint16") {
-            if (val < 0 || val > 65535) throw std::runtime_error(formatError(numNode->token, "Constant value out of range (uint16)"));
-        } else if (type == "uint32") {
-            if (val < 0 || val > 4294967295) throw std::runtime_error(formatError(numNode->token, "Constant value out of range (uint32)"));
+        generateCode(function);
+    } catch (...) {
+        std::swap(module, part);
+        putsFunc = puts;
+        throw;
+    }
+    std::swap(module, part);
+    putsFunc = puts;
+
+    return part;
+}
+
+std::vector<Codegen::GeneratedModule> Codegen::generateModules(const std::vector<NodeId>& functions, size_t functionsPerModule) {
+
+    // Across modules duplicate names would be duplicate definitions
+    if (!hasUniqueNames(functions)) {
+        generateFunctions(functions, 1);
+        return {};
+    }
+
+    std::vector<GeneratedModule> modules;
+    for (size_t begin = 0; begin < functions.size(); begin += functionsPerModule) {
+        size_t end = std::min(functions.size(), begin + functionsPerModule);
+
+        Codegen part(sourceManager, ast);
+        for (size_t i = begin; i < end; ++i) {
+            part.generateCode(functions[i]);
         }
-        // int32 and int64 are generally covered by the parser's integer limit (if strictly 32-bit int), but good to be safe.
+        modules.push_back({ std::move(part.context), std::move(part.module) });
+    }
+
+    // A user main keeps its name; declaring it here makes the wrapper pick "main.<n>"
+    for (NodeId function : functions) {
+        if (ast.get(function).name == "main")
+            declareFunction(function);
     }
 
-    // Evaluate validity of the expression
-    llvm::Value* initVal = generateExpression(constNode->value.get()).first;
+    return modules;
+}
+
+void Codegen::renameStringConstants() {
 
-    // Cast the value to the target type if necessary
-    if (initVal->getType() != llvmType) {
-        initVal = builder.CreateIntCast(initVal, llvmType, !isUnsignedType(constNode->type), "casttmp");
+    // Serially, the n-th string constant is named "str" (n = 0) or "str.<n>".
+    // The linker resolves the clashes between groups differently, so free all
+    // names first and then hand them out again in module order
+    std::vector<GlobalVariable*> strings;
+    for (GlobalVariable& global : module->globals()) {
+        if (global.hasPrivateLinkage() && global.getName().startswith("str"))
+            strings.push_back(&global);
     }
 
-    // Write the constant value to the variable
-    builder.CreateStore(initVal, allocaInst);
-    
+    for (GlobalVariable* global : strings) {
+        global->setName("");
+    }
+    for (size_t i = 0; i < strings.size(); ++i) {
+        strings[i]->setName(i == 0 ? std::string("str") : "str." + std::to_string(i));
+    }
+
+    serialRenameCount = strings.empty() ? 0 : strings.size() - 1;
+    linked = true;
+}
+
+void Codegen::generateReturn(const AstNode& returnNode, TypeId returnType) {
+    if (returnNode.value() == kNoNode) {
+        builder.CreateRetVoid();
+        return;
+    }
+
+    const AstNode& value = ast.get(returnNode.value());
+    llvm::Value* result = generateExpression(returnNode.value());
+    llvm::Value* retVal = convert(result, value.type, returnType);
+
+    // A call whose result is returned unchanged is in tail position. Between fastcc
+    // functions the backend then guarantees the tail call (GuaranteedTailCallOpt)
+    if (value.kind == NodeKind::Call && retVal == result && canTailCall(value))
+        cast<CallInst>(result)->setTailCall();
+
+    builder.CreateRet(retVal);
+}
+
+bool Codegen::canTailCall(const AstNode& call) const {
+    for (NodeId argument : ast.arguments(call)) {
+        if (typeTable.get(ast.get(argument).type).isAggregate())
+            return false;
+    }
+    return true;
+}
+
+llvm::Value* Codegen::generateExpression(NodeId id) {
+    const AstNode& node = ast.get(id);
+
+    switch (node.kind) {
+        case NodeKind::Number:
+        case NodeKind::Char:
+        case NodeKind::Constant:
+            return llvm::ConstantInt::get(getLLVMType(node.type), node.number, true);
+
+        case NodeKind::Variable: {
+            llvm::Value* value = namedValues[node.name];
+
+            // An array is only used by name where Sema converted it to a slice of all elements
+            if (auto* slot = dyn_cast<AllocaInst>(value)) {
+                if (auto* arrayType = dyn_cast<ArrayType>(slot->getAllocatedType())) {
+                    llvm::Value* data = builder.CreateInBoundsGEP(arrayType, slot, { builder.getInt64(0), builder.getInt64(0) }, "data");
+                    llvm::Value* slice = builder.CreateInsertValue(UndefValue::get(getLLVMType(node.type)), data, 0);
+                    return builder.CreateInsertValue(slice, builder.getInt64(arrayType->getNumElements()), 1, node.name);
+                }
+                return builder.CreateLoad(slot->getAllocatedType(), slot, node.name);
+            }
+            return value;
+        }
+
+        case NodeKind::Index: {
+            // The lanes of a vector are values, not memory
+            if (getVectorType(node.name)) {
+                llvm::Value* lane = generateIndex(node, getElements(node.name).length);
+                return builder.CreateExtractElement(loadVariable(node.name), lane, "lane");
+            }
+            llvm::Value* element = generateElementPointer(node);
+            return builder.CreateLoad(getLLVMType(node.type), element, "element");
+        }
+
+        case NodeKind::Slice:
+            return generateSlice(node);
+
+        case NodeKind::Length:
+            return getElements(node.name).length;
+
+        case NodeKind::Reduce:
+            return generateReduction(node);
+
+        case NodeKind::ArrayLiteral:
+            // Arrays are filled in memory (see generateArray), only vectors are literal values
+            return generateVectorLiteral(node);
+
+        case NodeKind::BinaryOp: {
+            const AstNode& leftNode = ast.get(node.left());
+            const AstNode& rightNode = ast.get(node.right());
+
+            llvm::Value* left = generateExpression(node.left());
+            llvm::Value* right = generateExpression(node.right());
+
+            // Both operands are brought to the type Sema chose for the operation
+            left = convert(left, leftNode.type, node.type);
+            right = convert(right, rightNode.type, node.type);
+
+            switch (node.op) {
+                case '+':
+                    return builder.CreateAdd(left, right, "addtmp");
+                case '-':
+                    return builder.CreateSub(left, right, "subtmp");
+                case '*':
+                    return builder.CreateMul(left, right, "multmp");
+                case '/':
+                    if (typeTable.isSigned(node.type))
+                        return builder.CreateSDiv(left, right, "divtmp");
+                    return builder.CreateUDiv(left, right, "divtmp");
+                default:
+                    throw std::runtime_error(formatError(node, "Unknown binary operator: " + std::string(1, node.op)));
+            }
+        }
+
+        case NodeKind::Call: {
+            // Sema has resolved the callee and checked the arguments
+            NodeId function = *ast.findFunction(node.name);
+            llvm::Function* callee = declareFunction(function);
+            NodeRange params = ast.parameters(ast.get(function));
+            NodeRange arguments = ast.arguments(node);
+
+            std::vector<llvm::Value*> args;
+            for (size_t i = 0; i < arguments.size(); ++i) {
+                const AstNode& argument = ast.get(arguments.begin()[i]);
+                llvm::Value* value = generateExpression(arguments.begin()[i]);
+                args.push_back(convert(value, argument.type, ast.get(params.begin()[i]).type));
+            }
+
+            llvm::CallInst* call = builder.CreateCall(callee, args, callee->getReturnType()->isVoidTy() ? "" : "calltmp");
+            call->setCallingConv(callee->getCallingConv());
+            return call;
+        }
+
+        default:
+            throw std::runtime_error(formatError(node, "Unknown expression node type"));
+    }
+}
+
+llvm::Value* Codegen::loadVariable(std::string_view name) {
+    llvm::Value* value = namedValues[name];
+    if (auto* slot = dyn_cast<AllocaInst>(value))
+        return builder.CreateLoad(slot->getAllocatedType(), slot, name);
+    return value;
+}
+
+Codegen::Elements Codegen::getElements(std::string_view name) {
+    if (FixedVectorType* vectorType = getVectorType(name))
+        return { nullptr, builder.getInt64(vectorType->getNumElements()), nullptr };
+
+    llvm::Value* value = namedValues[name];
+    if (auto* slot = dyn_cast<AllocaInst>(value)) {
+        if (auto* arrayType = dyn_cast<ArrayType>(slot->getAllocatedType()))
+            return { slot, builder.getInt64(arrayType->getNumElements()), arrayType };
+        value = builder.CreateLoad(slot->getAllocatedType(), slot, name);
+    }
+
+    // A slice: pointer and count
+    return { builder.CreateExtractValue(value, 0, "data"), builder.CreateExtractValue(value, 1, "length"), nullptr };
+}
+
+llvm::FixedVectorType* Codegen::getVectorType(std::string_view name) {
+    llvm::Value* value = namedValues[name];
+    if (auto* slot = dyn_cast<AllocaInst>(value))
+        return dyn_cast<FixedVectorType>(slot->getAllocatedType());
+    return dyn_cast<FixedVectorType>(value->getType());
+}
+
+bool Codegen::needsBoundsCheck(const AstNode& access) const {
+    switch (access.op) {
+        case boundsChecks::Elided:
+            return false;
+        case boundsChecks::Hoisted:
+            return uncheckedLoops.count(ast.get(access.left()).name) == 0;
+        default:
+            return true;
+    }
+}
+
+llvm::Value* Codegen::generateIndex(const AstNode& access, llvm::Value* length) {
+    const AstNode& indexNode = ast.get(access.left());
+    llvm::Value* index = convert(generateExpression(access.left()), indexNode.type, types::Int64);
+
+    // A negative index wraps to a large unsigned one, so one unsigned compare covers both ends
+    if (needsBoundsCheck(access))
+        generateBoundsCheck(builder.CreateICmpULT(index, length, "inbounds"));
+    return index;
+}
+
+llvm::Value* Codegen::generateElementPointer(const AstNode& access) {
+    Elements elements = getElements(access.name);
+    llvm::Value* index = generateIndex(access, elements.length);
+
+    if (elements.arrayType)
+        return builder.CreateInBoundsGEP(elements.arrayType, elements.data, { builder.getInt64(0), index }, "elementptr");
+    return builder.CreateInBoundsGEP(getLLVMType(access.type), elements.data, index, "elementptr");
+}
+
+llvm::Value* Codegen::generateSlice(const AstNode& slice) {
+    Elements elements = getElements(slice.name);
+    llvm::Value* first = convert(generateExpression(slice.left()), ast.get(slice.left()).type, types::Int64);
+    llvm::Value* end = convert(generateExpression(slice.right()), ast.get(slice.right()).type, types::Int64);
+
+    if (needsBoundsCheck(slice)) {
+        llvm::Value* ordered = builder.CreateICmpULE(first, end, "ordered");
+        llvm::Value* inBounds = builder.CreateICmpULE(end, elements.length, "inbounds");
+        generateBoundsCheck(builder.CreateAnd(ordered, inBounds, "inbounds"));
+    }
+
+    llvm::Value* data = elements.arrayType
+        ? builder.CreateInBoundsGEP(elements.arrayType, elements.data, { builder.getInt64(0), first }, "data")
+        : builder.CreateInBoundsGEP(getLLVMType(typeTable.get(slice.type).element), elements.data, first, "data");
+    llvm::Value* result = builder.CreateInsertValue(UndefValue::get(getLLVMType(slice.type)), data, 0);
+    return builder.CreateInsertValue(result, builder.CreateSub(end, first, "length"), 1, "slice");
+}
+
+llvm::Value* Codegen::generateVectorLiteral(const AstNode& literal) {
+    TypeId laneType = typeTable.get(literal.type).element;
+    llvm::Value* vector = UndefValue::get(getLLVMType(literal.type));
+
+    NodeRange elements = ast.elements(literal);
+    for (size_t i = 0; i < elements.size(); ++i) {
+        const AstNode& element = ast.get(elements.begin()[i]);
+        llvm::Value* value = convert(generateExpression(elements.begin()[i]), element.type, laneType);
+        vector = builder.CreateInsertElement(vector, value, builder.getInt64(i), "lanes");
+    }
+    return vector;
+}
+
+llvm::Value* Codegen::generateReduction(const AstNode& reduce) {
+    llvm::Value* vector = generateExpression(reduce.left());
+    bool isSigned = typeTable.isSigned(reduce.type);
+
+    // Like scalar arithmetic, sums and products wrap around
+    switch (reduce.op) {
+        case '+':
+            return builder.CreateAddReduce(vector);
+        case '*':
+            return builder.CreateMulReduce(vector);
+        case '<':
+            return builder.CreateIntMinReduce(vector, isSigned);
+        case '>':
+            return builder.CreateIntMaxReduce(vector, isSigned);
+        default:
+            throw std::runtime_error(formatError(reduce, "Unknown reduction"));
+    }
+}
+
+void Codegen::generateBoundsCheck(llvm::Value* inBounds) {
+    BasicBlock* okBB = BasicBlock::Create(*context, "bounds.ok", builder.GetInsertBlock()->getParent());
+    builder.CreateCondBr(inBounds, okBB, getBoundsFailBlock());
+    builder.SetInsertPoint(okBB);
+}
+
+llvm::BasicBlock* Codegen::getBoundsFailBlock() {
+    if (boundsFailBlock)
+        return boundsFailBlock;
+
+    // Added to the function and filled at its end (see generateCode)
+    boundsFailBlock = BasicBlock::Create(*context, "bounds.fail");
+    return boundsFailBlock;
+}
+
+void Codegen::generateBoundsFail() {
+    // Filled last, so write and llvm.trap are declared in the order of their uses, like the linker
+    // of generateInParallel declares them. The trap makes the branches to the block unlikely; the
+    // message goes to stderr unbuffered (write), as the trap ends the process without flushing
+    IRBuilder<> failBuilder(boundsFailBlock);
+    const char message[] = "Index out of bounds\n";
+    FunctionCallee write = module->getOrInsertFunction("write", builder.getInt64Ty(), builder.getInt32Ty(),
+                                                       builder.getInt8PtrTy(), builder.getInt64Ty());
+    failBuilder.CreateCall(write, { failBuilder.getInt32(2),
+                                    failBuilder.CreateGlobalStringPtr(message, "str", 0, module.get()),
+                                    failBuilder.getInt64(sizeof(message) - 1) });
+    failBuilder.CreateCall(Intrinsic::getDeclaration(module.get(), Intrinsic::trap));
+    failBuilder.CreateUnreachable();
+}
+
+void Codegen::generateConst(const AstNode& constNode) {
+    if (typeTable.get(constNode.type).kind == TypeKind::Array) {
+        generateArray(constNode);
+        return;
+    }
+
+    // A constant is never written again, so it needs no memory: its name stands for the
+    // initializer's value. Sema has already replaced the uses of compile-time constants
+    const AstNode& value = ast.get(constNode.value());
+    llvm::Value* initVal = convert(generateExpression(constNode.value()), value.type, constNode.type);
+
     // Register in symbol table after initialization to prevent self-reference
-    namedValues[constNode->name] = allocaInst;
-    isUnsignedVar[constNode->name] = isUnsignedType(constNode->type);
+    namedValues[constNode.name] = initVal;
 
 }
 
-void Codegen::generatePrint(const PrintNode* printNode) {
-    Value* strVal = builder.CreateGlobalStringPtr(printNode->text, "str");
+void Codegen::generateVar(const AstNode& varNode) {
+    if (typeTable.get(varNode.type).kind == TypeKind::Array) {
+        generateArray(varNode);
+        return;
+    }
+
+    const AstNode& value = ast.get(varNode.value());
+    llvm::Value* initVal = convert(generateExpression(varNode.value()), value.type, varNode.type);
+
+    AllocaInst* slot = createEntryAlloca(getLLVMType(varNode.type), varNode.name);
+    builder.CreateStore(initVal, slot);
+    namedValues[varNode.name] = slot;
+}
+
+void Codegen::generateAssign(const AstNode& assignNode) {
+    const AstNode& value = ast.get(assignNode.value());
+    llvm::Value* newVal = convert(generateExpression(assignNode.value()), value.type, assignNode.type);
+    builder.CreateStore(newVal, cast<AllocaInst>(namedValues[assignNode.name]));
+}
+
+void Codegen::generateIndexAssign(const AstNode& assignNode) {
+    // A lane is replaced in the whole vector, which lives in the slot of its var
+    if (getVectorType(assignNode.name)) {
+        llvm::Value* lane = generateIndex(assignNode, getElements(assignNode.name).length);
+        const AstNode& value = ast.get(assignNode.right());
+        llvm::Value* newVal = convert(generateExpression(assignNode.right()), value.type, assignNode.type);
+        auto* slot = cast<AllocaInst>(namedValues[assignNode.name]);
+        llvm::Value* vector = builder.CreateLoad(slot->getAllocatedType(), slot, assignNode.name);
+        builder.CreateStore(builder.CreateInsertElement(vector, newVal, lane, "insert"), slot);
+        return;
+    }
+
+    llvm::Value* element = generateElementPointer(assignNode);
+    const AstNode& value = ast.get(assignNode.right());
+    llvm::Value* newVal = convert(generateExpression(assignNode.right()), value.type, assignNode.type);
+    builder.CreateStore(newVal, element);
+}
+
+void Codegen::generateArray(const AstNode& decl) {
+    const TypeInfo& info = typeTable.get(decl.type);
+    auto* arrayType = cast<ArrayType>(getLLVMType(decl.type));
+
+    // The elements lie densely in one stack slot, like a C array
+    AllocaInst* slot = createEntryAlloca(arrayType, decl.name);
+    if (decl.value() == kNoNode) {
+        uint64_t bytes = info.length * (typeTable.get(info.element).bits / 8);
+        builder.CreateMemSet(slot, builder.getInt8(0), builder.getInt64(bytes), slot->getAlign());
+    } else {
+        NodeRange elements = ast.elements(ast.get(decl.value()));
+        for (size_t i = 0; i < elements.size(); ++i) {
+            const AstNode& element = ast.get(elements.begin()[i]);
+            llvm::Value* value = convert(generateExpression(elements.begin()[i]), element.type, info.element);
+            llvm::Value* address = builder.CreateInBoundsGEP(arrayType, slot, { builder.getInt64(0), builder.getInt64(i) });
+            builder.CreateStore(value, address);
+        }
+    }
+
+    // Registered after the initializer, like constants
+    namedValues[decl.name] = slot;
+}
+
+AllocaInst* Codegen::createEntryAlloca(llvm::Type* type, std::string_view name) {
+    // Slots stay together at the top of the entry block, in declaration order, where mem2reg finds them
+    BasicBlock& entry = builder.GetInsertBlock()->getParent()->getEntryBlock();
+    BasicBlock::iterator position = entry.begin();
+    while (position != entry.end() && isa<AllocaInst>(*position)) ++position;
+
+    IRBuilder<> entryBuilder(&entry, position);
+    return entryBuilder.CreateAlloca(type, nullptr, name);
+}
+
+llvm::Value* Codegen::generateCondition(NodeId id) {
+    const AstNode& node = ast.get(id);
+    llvm::Value* left = convert(generateExpression(node.left()), ast.get(node.left()).type, node.type);
+    llvm::Value* right = convert(generateExpression(node.right()), ast.get(node.right()).type, node.type);
+
+    bool isSigned = typeTable.isSigned(node.type);
+    CmpInst::Predicate predicate;
+    switch (node.op) {
+        case compareOps::Equal:        predicate = CmpInst::ICMP_EQ; break;
+        case compareOps::NotEqual:     predicate = CmpInst::ICMP_NE; break;
+        case compareOps::Less:         predicate = isSigned ? CmpInst::ICMP_SLT : CmpInst::ICMP_ULT; break;
+        case compareOps::LessEqual:    predicate = isSigned ? CmpInst::ICMP_SLE : CmpInst::ICMP_ULE; break;
+        case compareOps::Greater:      predicate = isSigned ? CmpInst::ICMP_SGT : CmpInst::ICMP_UGT; break;
+        case compareOps::GreaterEqual: predicate = isSigned ? CmpInst::ICMP_SGE : CmpInst::ICMP_UGE; break;
+        default:
+            throw std::runtime_error(formatError(node, "Unknown comparison operator"));
+    }
+    return builder.CreateICmp(predicate, left, right, "cmptmp");
+}
+
+void Codegen::generateWhile(const AstNode& loop, TypeId returnType) {
+    Function* func = builder.GetInsertBlock()->getParent();
+    BasicBlock* condBB = BasicBlock::Create(*context, "while.cond", func);
+    BasicBlock* bodyBB = BasicBlock::Create(*context, "while.body");
+    BasicBlock* exitBB = BasicBlock::Create(*context, "while.end");
+
+    builder.CreateBr(condBB);
+    builder.SetInsertPoint(condBB);
+    builder.CreateCondBr(generateCondition(ast.condition(loop)), bodyBB, exitBB);
+
+    // Blocks are added when they are reached, so a nested loop lies between body and exit
+    func->getBasicBlockList().push_back(bodyBB);
+    builder.SetInsertPoint(bodyBB);
+    std::map<std::string_view, llvm::Value*> outer = namedValues;
+    generateStatements(ast.loopBody(loop), returnType, false);
+    namedValues = std::move(outer);
+    if (!builder.GetInsertBlock()->getTerminator())
+        builder.CreateBr(condBB);
+
+    func->getBasicBlockList().push_back(exitBB);
+    builder.SetInsertPoint(exitBB);
+}
+
+void Codegen::generateFor(const AstNode& loop, TypeId returnType) {
+    Function* func = builder.GetInsertBlock()->getParent();
+    llvm::Type* type = getLLVMType(loop.type);
+
+    // The bounds are evaluated once, before the first iteration
+    NodeId startId = ast.rangeStart(loop);
+    NodeId endId = ast.rangeEnd(loop);
+    llvm::Value* start = convert(generateExpression(startId), ast.get(startId).type, loop.type);
+    llvm::Value* end = convert(generateExpression(endId), ast.get(endId).type, loop.type);
+
+    AllocaInst* slot = createEntryAlloca(type, loop.name);
+    builder.CreateStore(start, slot);
+    BasicBlock* exitBB = BasicBlock::Create(*context, "for.end");
+
+    std::vector<std::string_view> hoisted;
+    collectHoisted(ast.loopBody(loop), loop.name, hoisted);
+    if (hoisted.empty()) {
+        generateForLoop(loop, end, slot, exitBB, returnType);
+    } else {
+        // Every index lies in [start, end): the loop is either empty, or start >= 0 and end <= length
+        bool isSigned = typeTable.isSigned(loop.type);
+        llvm::Value* first = convert(start, loop.type, types::Int64);
+        llvm::Value* last = convert(end, loop.type, types::Int64);
+        llvm::Value* empty = isSigned ? builder.CreateICmpSLE(last, first, "empty")
+                                      : builder.CreateICmpULE(last, first, "empty");
+        llvm::Value* inBounds = isSigned ? builder.CreateICmpSGE(first, builder.getInt64(0), "inbounds")
+                                         : builder.getTrue();
+        for (std::string_view base : hoisted) {
+            llvm::Value* fits = builder.CreateICmpULE(last, getElements(base).length, "inbounds");
+            inBounds = builder.CreateAnd(inBounds, fits, "inbounds");
+        }
+
+        BasicBlock* uncheckedBB = BasicBlock::Create(*context, "for.unchecked", func);
+        BasicBlock* checkedBB = BasicBlock::Create(*context, "for.checked");
+        builder.CreateCondBr(builder.CreateOr(empty, inBounds, "rangeok"), uncheckedBB, checkedBB);
+
+        // Nested loops may reuse the name; their state is restored when they end
+        bool wasUnchecked = uncheckedLoops.count(loop.name) != 0;
+        builder.SetInsertPoint(uncheckedBB);
+        uncheckedLoops.insert(loop.name);
+        generateForLoop(loop, end, slot, exitBB, returnType);
+
+        func->getBasicBlockList().push_back(checkedBB);
+        builder.SetInsertPoint(checkedBB);
+        builder.CreateStore(start, slot);
+        uncheckedLoops.erase(loop.name);
+        generateForLoop(loop, end, slot, exitBB, returnType);
+
+        if (wasUnchecked)
+            uncheckedLoops.insert(loop.name);
+    }
+
+    func->getBasicBlockList().push_back(exitBB);
+    builder.SetInsertPoint(exitBB);
+}
+
+void Codegen::generateForLoop(const AstNode& loop, llvm::Value* end, AllocaInst* slot,
+                              BasicBlock* exitBB, TypeId returnType) {
+    Function* func = builder.GetInsertBlock()->getParent();
+    llvm::Type* type = slot->getAllocatedType();
+    bool isSigned = typeTable.isSigned(loop.type);
+
+    BasicBlock* condBB = BasicBlock::Create(*context, "for.cond", func);
+    BasicBlock* bodyBB = BasicBlock::Create(*context, "for.body");
+    BasicBlock* latchBB = BasicBlock::Create(*context, "for.latch");
+
+    builder.CreateBr(condBB);
+    builder.SetInsertPoint(condBB);
+    llvm::Value* index = builder.CreateLoad(type, slot, loop.name);
+    llvm::Value* inRange = isSigned ? builder.CreateICmpSLT(index, end, "forcond")
+                                    : builder.CreateICmpULT(index, end, "forcond");
+    builder.CreateCondBr(inRange, bodyBB, exitBB);
+
+    func->getBasicBlockList().push_back(bodyBB);
+    builder.SetInsertPoint(bodyBB);
+    std::map<std::string_view, llvm::Value*> outer = namedValues;
+    namedValues[loop.name] = slot;
+    generateStatements(ast.loopBody(loop), returnType, false);
+    namedValues = std::move(outer);
+    if (!builder.GetInsertBlock()->getTerminator())
+        builder.CreateBr(latchBB);
+
+    // The index is below end, so the increment cannot wrap
+    func->getBasicBlockList().push_back(latchBB);
+    builder.SetInsertPoint(latchBB);
+    llvm::Value* current = builder.CreateLoad(type, slot, loop.name);
+    llvm::Value* next = builder.CreateAdd(current, ConstantInt::get(type, 1), "fornext", !isSigned, isSigned);
+    builder.CreateStore(next, slot);
+    addLoopHints(builder.CreateBr(condBB), loop);
+}
+
+void Codegen::collectHoisted(NodeRange statements, std::string_view name, std::vector<std::string_view>& bases) const {
+    for (NodeId stmt : statements) {
+        const AstNode& node = ast.get(stmt);
+        switch (node.kind) {
+            case NodeKind::Const:
+            case NodeKind::Var:
+            case NodeKind::Assign:
+            case NodeKind::Return:
+                if (node.value() != kNoNode)
+                    collectHoisted(node.value(), name, bases);
+                break;
+            case NodeKind::IndexAssign:
+            case NodeKind::Call:
+                collectHoisted(stmt, name, bases);
+                break;
+            case NodeKind::While:
+                collectHoisted(ast.condition(node), name, bases);
+                collectHoisted(ast.loopBody(node), name, bases);
+                break;
+            case NodeKind::For:
+                // The range belongs to the enclosing scope; a loop variable of the same name hides this one
+                collectHoisted(ast.rangeStart(node), name, bases);
+                collectHoisted(ast.rangeEnd(node), name, bases);
+                if (node.name != name)
+                    collectHoisted(ast.loopBody(node), name, bases);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void Codegen::collectHoisted(NodeId expression, std::string_view name, std::vector<std::string_view>& bases) const {
+    const AstNode& node = ast.get(expression);
+    switch (node.kind) {
+        case NodeKind::Index:
+        case NodeKind::IndexAssign:
+            if (node.op == boundsChecks::Hoisted && ast.get(node.left()).name == name &&
+                std::find(bases.begin(), bases.end(), node.name) == bases.end())
+                bases.push_back(node.name);
+            collectHoisted(node.left(), name, bases);
+            if (node.kind == NodeKind::IndexAssign)
+                collectHoisted(node.right(), name, bases);
+            break;
+        case NodeKind::BinaryOp:
+        case NodeKind::Compare:
+        case NodeKind::Slice:
+            collectHoisted(node.left(), name, bases);
+            collectHoisted(node.right(), name, bases);
+            break;
+        case NodeKind::Call:
+            for (NodeId argument : ast.arguments(node))
+                collectHoisted(argument, name, bases);
+            break;
+        case NodeKind::ArrayLiteral:
+            for (NodeId element : ast.elements(node))
+                collectHoisted(element, name, bases);
+            break;
+        case NodeKind::Reduce:
+            collectHoisted(node.left(), name, bases);
+            break;
+        default:
+            break;
+    }
+}
+
+void Codegen::addLoopHints(BranchInst* backedge, const AstNode& loop) {
+    auto hint = [this] (StringRef name, std::optional<bool> value = std::nullopt) -> Metadata* {
+        SmallVector<Metadata*, 2> operands { MDString::get(*context, name) };
+        if (value)
+            operands.push_back(ConstantAsMetadata::get(builder.getInt1(*value)));
+        return MDNode::get(*context, operands);
+    };
+
+    // The first operand of a loop id refers to the node itself
+    SmallVector<Metadata*, 4> operands { nullptr, hint("llvm.loop.mustprogress") };
+
+    // Sema folded constant bounds, so a constant trip count is visible here
+    auto isConstant = [] (const AstNode& node) {
+        return node.kind == NodeKind::Number || node.kind == NodeKind::Char || node.kind == NodeKind::Constant;
+    };
+    const AstNode& start = ast.get(ast.rangeStart(loop));
+    const AstNode& end = ast.get(ast.rangeEnd(loop));
+    std::optional<uint64_t> tripCount;
+    if (isConstant(start) && isConstant(end)) {
+        bool empty = typeTable.isSigned(loop.type) ? end.number <= start.number
+                                                   : static_cast<uint64_t>(end.number) <= static_cast<uint64_t>(start.number);
+        tripCount = empty ? 0 : static_cast<uint64_t>(end.number) - static_cast<uint64_t>(start.number);
+    }
+
+    if (tripCount && *tripCount <= kFullUnrollTripCount)
+        operands.push_back(hint("llvm.loop.unroll.full"));
+    else if (isComputeOnly(ast.loopBody(loop)))
+        operands.push_back(hint("llvm.loop.vectorize.enable", true));
+
+    MDNode* loopId = MDNode::getDistinct(*context, operands);
+    loopId->replaceOperandWith(0, loopId);
+    backedge->setMetadata(LLVMContext::MD_loop, loopId);
+}
+
+bool Codegen::isComputeOnly(NodeRange statements) const {
+    for (NodeId stmt : statements) {
+        const AstNode& node = ast.get(stmt);
+        switch (node.kind) {
+            case NodeKind::Const:
+            case NodeKind::Var:
+            case NodeKind::Assign:
+                if (node.value() != kNoNode && !computesOnly(node.value()))
+                    return false;
+                break;
+            case NodeKind::IndexAssign:
+                if (!computesOnly(stmt))
+                    return false;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool Codegen::computesOnly(NodeId id) const {
+    const AstNode& node = ast.get(id);
+    switch (node.kind) {
+        case NodeKind::Call:
+            return false;
+        case NodeKind::BinaryOp:
+            return computesOnly(node.left()) && computesOnly(node.right());
+        case NodeKind::Reduce:
+            return computesOnly(node.left());
+        case NodeKind::Index:
+            return !needsBoundsCheck(node) && computesOnly(node.left());
+        case NodeKind::IndexAssign:
+        case NodeKind::Slice:
+            return !needsBoundsCheck(node) && computesOnly(node.left()) && computesOnly(node.right());
+        case NodeKind::ArrayLiteral:
+            for (NodeId element : ast.elements(node)) {
+                if (!computesOnly(element))
+                    return false;
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+void Codegen::generatePrint(const AstNode& printNode) {
+    Value* strVal = builder.CreateGlobalStringPtr(printNode.name, "str");
     builder.CreateCall(putsFunc, strVal);
 }
 
-void Codegen::createMainWrapper(const std::string& targetFuncName) {
+llvm::Function* Codegen::createMainWrapper(NodeId function) {
     llvm::FunctionType* mainType = llvm::FunctionType::get(builder.getInt32Ty(), false);
-    llvm::Function* mainFunc = llvm::Function::Create(mainType, llvm::Function::ExternalLinkage, "main", module.get());
-    llvm::BasicBlock* mainBB = llvm::BasicBlock::Create(context, "entry", mainFunc);
+
+    // A user function called main pushes the wrapper to "main.<n>"; in a linked
+    // module the counter behind <n> differs, so use the serial name explicitly
+    std::string mainName = "main";
+    if (linked && module->getFunction("main"))
+        mainName = "main." + std::to_string(serialRenameCount + 1);
+
+    llvm::Function* mainFunc = llvm::Function::Create(mainType, llvm::Function::ExternalLinkage, mainName, module.get());
+    llvm::BasicBlock* mainBB = llvm::BasicBlock::Create(*context, "entry", mainFunc);
     
     // Save current insert point
     auto savedInsertBlock = builder.GetInsertBlock();
@@ -233,24 +1111,34 @@ void Codegen::createMainWrapper(const std::string& targetFuncName) {
 
     builder.SetInsertPoint(mainBB);
     
-    llvm::Function* targetFunc = module->getFunction(targetFuncName);
-    if (!targetFunc) {
-        throw std::runtime_error("Function " + targetFuncName + " not found in module");
-    }
+    // The target is only declared here if it was generated into another module
+    llvm::Function* targetFunc = declareFunction(function);
 
-    builder.CreateCall(targetFunc);
-    builder.CreateRet(llvm::ConstantInt::get(builder.getInt32Ty(), 0));
+    // The value of the target is the exit status (0 for a void target)
+    llvm::CallInst* call = builder.CreateCall(targetFunc);
+    call->setCallingConv(targetFunc->getCallingConv());
+    TypeId returnType = ast.get(function).type;
+    if (typeTable.get(returnType).isVoid())
+        builder.CreateRet(llvm::ConstantInt::get(builder.getInt32Ty(), 0));
+    else
+        builder.CreateRet(convert(call, returnType, types::Int32));
     llvm::verifyFunction(*mainFunc);
     
     // Restore insert point (optional, but good practice if we were doing more)
     if (savedInsertBlock)
         builder.SetInsertPoint(savedInsertBlock, savedInsertPoint);
+
+    return mainFunc;
 }
 
-void Codegen::printModule() const {
-    module->print(outs(), nullptr);
+void Codegen::printModule(raw_ostream& out) const {
+    module->print(out, nullptr);
 }
 
 std::unique_ptr<llvm::Module>& Codegen::getModule() {
     return module;
 }
+
+std::unique_ptr<llvm::LLVMContext> Codegen::takeContext() {
+    return std::move(context);
+}
@@ -0,0 +1,421 @@
+#include "../include/CompileCache.h"
+#include "../include/Logger.h"
+#include "../include/ScopedLogger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/SHA256.h>
+
+#ifndef PICC_VERSION
+#define PICC_VERSION "unknown"
+#endif
+
+namespace {
+
+/// @brief Writes all of data to fd (write may be partial)
+void writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Cannot write cache data: ") + std::strerror(errno));
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+/// @brief Whether name consists of exactly length lowercase hex digits (entry paths are key digits)
+bool isHexName(const char* name, size_t length) {
+    size_t i = 0;
+    for (; name[i] != '\0'; ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(name[i])) && (name[i] < 'a' || name[i] > 'f'))
+            return false;
+    }
+    return i == length;
+}
+
+} // namespace
+
+CompileCache::CompileCache(std::string directory, uint64_t maxBytes)
+    : directory(std::move(directory)), maxBytes(maxBytes) {
+}
+
+CompileCache::~CompileCache() {
+    flush();
+}
+
+std::string CompileCache::defaultDirectory() {
+    if (const char* dir = std::getenv("PICC_CACHE_DIR"); dir && *dir)
+        return dir;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+        return std::string(xdg) + "/picc";
+    if (const char* home = std::getenv("HOME"); home && *home)
+        return std::string(home) + "/.cache/picc";
+    return ".picc-cache";
+}
+
+std::string CompileCache::functionStoreDirectory() {
+    return defaultDirectory() + "/functions";
+}
+
+uint64_t CompileCache::defaultMaxBytes() {
+    uint64_t mebibytes = 512;
+    if (const char* size = std::getenv("PICC_CACHE_MAX_SIZE"); size && *size)
+        mebibytes = std::strtoull(size, nullptr, 10);
+    return mebibytes * 1024 * 1024;
+}
+
+std::string CompileCache::compilerIdentity(const char* argv0) {
+    std::string identity = "picc " PICC_VERSION " llvm " LLVM_VERSION_STRING;
+
+    // Like ccache's default compiler check: size and mtime of the executable
+    std::string executable = llvm::sys::fs::getMainExecutable(argv0, reinterpret_cast<void*>(&compilerIdentity));
+    struct stat info;
+    if (!executable.empty() && stat(executable.c_str(), &info) == 0)
+        identity += " " + std::to_string(info.st_size) + " " + std::to_string(info.st_mtime);
+
+    return identity;
+}
+
+std::string CompileCache::computeKey(const std::string& compiler, const std::string& options, std::string_view source) {
+    llvm::SHA256 hash;
+
+    // Lengths separate the fields, so no two inputs share a byte stream
+    for (std::string_view field : { std::string_view(compiler), std::string_view(options), source }) {
+        hash.update(std::to_string(field.size()) + ":");
+        hash.update(llvm::StringRef(field.data(), field.size()));
+    }
+    return llvm::toHex(hash.final(), true);
+}
+
+std::vector<std::string> CompileCache::computeFunctionKeys(const std::string& compiler, const std::string& options,
+                                                          const TokenBuffer& tokens, const std::vector<size_t>& boundaries) {
+    // Kind and length-prefixed spelling per token. The EOF token is left out,
+    // so the last function keeps its key when another one is appended
+    auto appendTokens = [&tokens] (std::string& sequence, size_t begin, size_t end) {
+        for (size_t token = begin; token < end; ++token) {
+            if (tokens.kind(token) == TOKEN_EOF)
+                break;
+            std::string_view spelling = tokens.spelling(token);
+            sequence += static_cast<char>(tokens.kind(token));
+            sequence += std::to_string(spelling.size()) + ":";
+            sequence += spelling;
+        }
+    };
+    auto functionEnd = [&] (size_t i) {
+        return i + 1 < boundaries.size() ? boundaries[i + 1] : tokens.size();
+    };
+    auto bodyStart = [&] (size_t i) {
+        size_t token = boundaries[i];
+        while (token < functionEnd(i) && tokens.kind(token) != TOKEN_LBRACE)
+            ++token;
+        return token;
+    };
+
+    // A call compiles against the callee's header (export, parameters, return
+    // type), so the headers of all callees are part of the caller's key
+    std::unordered_map<std::string_view, std::string> headers;
+    for (size_t i = 0; i < boundaries.size(); ++i) {
+        size_t name = boundaries[i];
+        while (name < functionEnd(i) && tokens.kind(name) != TOKEN_IDENT)
+            ++name;
+        if (name == functionEnd(i))
+            continue;
+        std::string& header = headers[tokens.spelling(name)];
+        appendTokens(header, boundaries[i], bodyStart(i));
+    }
+
+    std::vector<std::string> keys;
+    keys.reserve(boundaries.size());
+
+    std::string sequence;
+    for (size_t i = 0; i < boundaries.size(); ++i) {
+        size_t end = functionEnd(i);
+
+        sequence.clear();
+        appendTokens(sequence, boundaries[i], end);
+
+        std::vector<std::string_view> callees;
+        for (size_t token = bodyStart(i); token + 1 < end; ++token) {
+            if (tokens.kind(token) == TOKEN_IDENT && tokens.kind(token + 1) == TOKEN_LPAREN)
+                callees.push_back(tokens.spelling(token));
+        }
+        std::sort(callees.begin(), callees.end());
+        callees.erase(std::unique(callees.begin(), callees.end()), callees.end());
+
+        for (std::string_view callee : callees) {
+            auto header = headers.find(callee);
+            if (header == headers.end())
+                continue;   // Unknown function: Sema rejects the program
+            sequence += "calls " + std::to_string(header->second.size()) + ":";
+            sequence += header->second;
+        }
+        keys.push_back(computeKey(compiler, "function " + options, sequence));
+    }
+    return keys;
+}
+
+std::string CompileCache::entryPath(const std::string& key) const {
+    return directory + "/" + key.substr(0, 2) + "/" + key.substr(2);
+}
+
+std::string CompileCache::lookup(const std::string& key) {
+    std::string path = entryPath(key);
+    bool hit = access(path.c_str(), R_OK) == 0;
+
+    // The modification time is the last use (for LRU eviction)
+    if (hit)
+        utimes(path.c_str(), nullptr);
+
+    if (hit) pending.hits++;
+    else pending.misses++;
+    dirty = true;
+
+    LOG_DEBUG(std::string("Compile cache ") + (hit ? "hit: " : "miss: ") + key);
+    return hit ? path : std::string();
+}
+
+std::string CompileCache::store(const std::string& key, std::string_view data) {
+    LOG_SCOPE("Cache Store");
+
+    std::string path = entryPath(key);
+    std::string subdirectory = directory + "/" + key.substr(0, 2);
+    if (std::error_code error = llvm::sys::fs::create_directories(subdirectory))
+        throw std::runtime_error("Cannot create cache directory " + subdirectory + ": " + error.message());
+
+    // Written under a unique name and renamed: readers see the whole entry or none. The name is
+    // unique per call, not per process, because batch compiles store from several threads.
+    int fd = -1;
+    llvm::SmallString<128> temporaryPath;
+    unsigned mode = llvm::sys::fs::owner_read | llvm::sys::fs::owner_write | llvm::sys::fs::group_read | llvm::sys::fs::others_read;
+    if (std::error_code error = llvm::sys::fs::createUniqueFile(path + ".tmp.%%%%%%%%", fd, temporaryPath, llvm::sys::fs::OF_None, mode))
+        throw std::runtime_error("Cannot create cache entry " + path + ": " + error.message());
+    std::string temporary(temporaryPath.str());
+
+    try {
+        writeAll(fd, data.data(), data.size());
+    } catch (...) {
+        close(fd);
+        unlink(temporary.c_str());
+        throw;
+    }
+    close(fd);
+
+    bool existed = access(path.c_str(), F_OK) == 0;
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        int error = errno;
+        unlink(temporary.c_str());
+
+        // Another writer stored the same key first; entries are content-addressed, so it is the same data
+        if (access(path.c_str(), R_OK) == 0)
+            return path;
+        throw std::runtime_error("Cannot store cache entry " + path + ": " + std::strerror(error));
+    }
+
+    if (!existed) {
+        pending.entries++;
+        pending.bytes += data.size();
+    }
+    dirty = true;
+
+    return path;
+}
+
+void CompileCache::flush() {
+    if (!dirty)
+        return;
+
+    updateStats([this] (Stats& stats) {
+        stats.hits += pending.hits;
+        stats.misses += pending.misses;
+        stats.entries += pending.entries;
+        stats.bytes += pending.bytes;
+        if (stats.bytes > maxBytes)
+            evict(stats);
+    });
+
+    pending = Stats();
+    dirty = false;
+}
+
+void CompileCache::copyFile(const std::string& path, int fd) {
+    int input = open(path.c_str(), O_RDONLY);
+    if (input < 0)
+        throw std::runtime_error("Cannot open cache entry " + path + ": " + std::strerror(errno));
+
+    struct stat info;
+    if (fstat(input, &info) != 0) {
+        close(input);
+        throw std::runtime_error("Cannot stat cache entry " + path + ": " + std::strerror(errno));
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        close(input);
+        return;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, input, 0);
+    close(input);
+    if (data == MAP_FAILED)
+        throw std::runtime_error("Cannot map cache entry " + path + ": " + std::strerror(errno));
+
+    try {
+        writeAll(fd, static_cast<const char*>(data), size);
+    } catch (...) {
+        munmap(data, size);
+        throw;
+    }
+    munmap(data, size);
+}
+
+template <typename Update>
+void CompileCache::updateStats(Update update) {
+    if (llvm::sys::fs::create_directories(directory))
+        return;     // Statistics are best effort; a broken cache directory surfaces in store()
+
+    std::string path = directory + "/stats";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return;
+
+    flock(fd, LOCK_EX);
+
+    // "<name> <value>" per line
+    Stats stats;
+    std::string text;
+    char buffer[512];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        text.append(buffer, static_cast<size_t>(count));
+    }
+
+    std::istringstream in(text);
+    std::string name;
+    uint64_t value;
+    while (in >> name >> value) {
+        if (name == "hits") stats.hits = value;
+        else if (name == "misses") stats.misses = value;
+        else if (name == "evictions") stats.evictions = value;
+        else if (name == "entries") stats.entries = value;
+        else if (name == "bytes") stats.bytes = value;
+    }
+
+    update(stats);
+
+    std::string out = "hits " + std::to_string(stats.hits) + "\n" +
+                      "misses " + std::to_string(stats.misses) + "\n" +
+                      "evictions " + std::to_string(stats.evictions) + "\n" +
+                      "entries " + std::to_string(stats.entries) + "\n" +
+                      "bytes " + std::to_string(stats.bytes) + "\n";
+    if (ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0) {
+        try {
+            writeAll(fd, out.data(), out.size());
+        } catch (const std::runtime_error&) {
+            // Lost counters are not worth failing a compile
+        }
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+void CompileCache::evict(Stats& stats) {
+    LOG_SCOPE("Cache Eviction");
+
+    struct Entry {
+        std::string path;
+        uint64_t size;
+        int64_t lastUse;
+    };
+    std::vector<Entry> entries;
+
+    // Only names of the form <2 hex digits>/<62 hex digits> are entries; the scan
+    // also corrects the counters if other processes raced on them
+    DIR* root = opendir(directory.c_str());
+    if (!root)
+        return;
+    while (dirent* sub = readdir(root)) {
+        if (!isHexName(sub->d_name, 2))
+            continue;
+        std::string subdirectory = directory + "/" + sub->d_name;
+        DIR* dir = opendir(subdirectory.c_str());
+        if (!dir)
+            continue;
+        while (dirent* file = readdir(dir)) {
+            std::string path = subdirectory + "/" + file->d_name;
+            struct stat info;
+            if (!isHexName(file->d_name, 62) || stat(path.c_str(), &info) != 0)
+                continue;
+            entries.push_back({ path, static_cast<uint64_t>(info.st_size), static_cast<int64_t>(info.st_mtime) });
+        }
+        closedir(dir);
+    }
+    closedir(root);
+
+    std::sort(entries.begin(), entries.end(), [] (const Entry& a, const Entry& b) {
+        return a.lastUse < b.lastUse;
+    });
+
+    uint64_t total = 0;
+    for (const Entry& entry : entries) total += entry.size;
+
+    uint64_t target = maxBytes / 10 * 9;
+    size_t removed = 0;
+    for (const Entry& entry : entries) {
+        if (total <= target) break;
+        if (unlink(entry.path.c_str()) == 0) {
+            total -= entry.size;
+            removed++;
+        }
+    }
+
+    LOG_INFO("Compile cache: evicted " + std::to_string(removed) + " entries");
+    stats.evictions += removed;
+    stats.entries = entries.size() - removed;
+    stats.bytes = total;
+}
+
+std::string CompileCache::formatStats() {
+    flush();
+
+    Stats current;
+    updateStats([&current] (Stats& stats) { current = stats; });
+
+    uint64_t lookups = current.hits + current.misses;
+    double hitRate = lookups > 0 ? 100.0 * current.hits / lookups : 0.0;
+
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(1)
+           << "Cache directory     " << directory << "\n"
+           << "Hits                " << current.hits << "\n"
+           << "Misses              " << current.misses << "\n"
+           << "Hit rate            " << hitRate << " %\n"
+           << "Entries             " << current.entries << "\n"
+           << "Size                " << current.bytes / (1024.0 * 1024.0) << " MiB\n"
+           << "Size limit          " << maxBytes / (1024.0 * 1024.0) << " MiB\n"
+           << "Evictions           " << current.evictions << "\n";
+    return report.str();
+}
@@ -0,0 +1,397 @@
+#include "../include/CompileServer.h"
+#include "../include/Logger.h"
+#include "../include/Profiler.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace {
+
+/// @brief Standard input, output and error travel with every request
+constexpr int kPassedDescriptors = 3;
+
+/// @brief Written to by the signal handlers, watched by the server loop (self-pipe)
+int wakeupPipe[2] = { -1, -1 };
+volatile sig_atomic_t stopRequested = 0;
+
+void onSignal(int signal) {
+    int savedErrno = errno;
+    if (signal != SIGCHLD)
+        stopRequested = 1;
+    char byte = 0;
+    (void)!write(wakeupPipe[1], &byte, 1);
+    errno = savedErrno;
+}
+
+void writeAll(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Cannot write to the compile server connection: ") + std::strerror(errno));
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+/// @brief Reads exactly size bytes; false on end of file
+bool readAll(int fd, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t count = read(fd, bytes, size);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Cannot read from the compile server connection: ") + std::strerror(errno));
+        }
+        if (count == 0)
+            return false;
+        bytes += count;
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Socket path too long: " + path);
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+/// @brief Connects to the socket; -1 if nobody listens there
+int connectTo(const std::string& path) {
+    sockaddr_un address = socketAddress(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw std::runtime_error(std::string("Cannot create a socket: ") + std::strerror(errno));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// @brief Splits the request payload: NUL-terminated strings
+std::vector<std::string> splitPayload(const std::string& payload) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (start < payload.size()) {
+        size_t end = payload.find('\0', start);
+        if (end == std::string::npos)
+            end = payload.size();
+        fields.push_back(payload.substr(start, end - start));
+        start = end + 1;
+    }
+    return fields;
+}
+
+} // namespace
+
+CompileServer::CompileServer(std::string socketPath) : socketPath(std::move(socketPath)) {
+}
+
+std::string CompileServer::defaultSocketPath() {
+    if (const char* path = std::getenv("PICC_SERVER_SOCKET"); path && *path)
+        return path;
+    if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime)
+        return std::string(runtime) + "/picc.sock";
+    return "/tmp/picc-" + std::to_string(getuid()) + ".sock";
+}
+
+void CompileServer::listenOnSocket() {
+
+    // A socket file nobody accepts on is left over from a server that died
+    int existing = connectTo(socketPath);
+    if (existing >= 0) {
+        close(existing);
+        throw std::runtime_error("A compile server is already listening on " + socketPath);
+    }
+    unlink(socketPath.c_str());
+
+    sockaddr_un address = socketAddress(socketPath);
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0)
+        throw std::runtime_error(std::string("Cannot create a socket: ") + std::strerror(errno));
+
+    // Only the owner may connect: a request runs with the server's rights
+    mode_t oldMask = umask(0077);
+    int bound = bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    umask(oldMask);
+    if (bound != 0 || listen(listenFd, SOMAXCONN) != 0) {
+        std::string error = std::strerror(errno);
+        close(listenFd);
+        throw std::runtime_error("Cannot listen on " + socketPath + ": " + error);
+    }
+}
+
+int CompileServer::serve(const CompileFunction& compile, const char* argv0) {
+    listenOnSocket();
+
+    if (pipe(wakeupPipe) != 0)
+        throw std::runtime_error(std::string("Cannot create a pipe: ") + std::strerror(errno));
+    for (int fd : wakeupPipe) {
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    struct sigaction action {};
+    action.sa_handler = onSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    // A client that went away must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    LOG_INFO("Compile server listening on " + socketPath);
+    std::cerr << "picc: compile server listening on " << socketPath << std::endl;
+
+    while (!stopRequested) {
+        pollfd watched[2] = { { listenFd, POLLIN, 0 }, { wakeupPipe[0], POLLIN, 0 } };
+        if (poll(watched, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+        }
+
+        if (watched[1].revents & POLLIN) {
+            char drain[64];
+            while (read(wakeupPipe[0], drain, sizeof(drain)) > 0) {}
+            reapChildren();
+        }
+
+        if (!(watched[0].revents & POLLIN) || stopRequested)
+            continue;
+
+        int connection = accept(listenFd, nullptr, nullptr);
+        if (connection < 0)
+            continue;
+        fcntl(connection, F_SETFD, FD_CLOEXEC);
+
+        // Buffered output would otherwise be written once more by the child
+        std::cout.flush();
+        std::cerr.flush();
+        std::fflush(nullptr);
+
+        pid_t child = fork();
+        if (child == 0)
+            handleRequest(connection, compile, argv0);
+
+        if (child < 0) {
+            LOG_ERROR(std::string("Cannot fork a compile request: ") + std::strerror(errno));
+            close(connection);
+            continue;
+        }
+        running[child] = connection;
+    }
+
+    // Requests in progress are finished before the server goes away
+    close(listenFd);
+    unlink(socketPath.c_str());
+    while (!running.empty()) {
+        int status = 0;
+        pid_t child = waitpid(-1, &status, 0);
+        if (child > 0)
+            finishRequest(child, status);
+        else if (errno != EINTR)
+            break;
+    }
+
+    LOG_INFO("Compile server stopped");
+    return 0;
+}
+
+void CompileServer::reapChildren() {
+    int status = 0;
+    pid_t child;
+    while ((child = waitpid(-1, &status, WNOHANG)) > 0) {
+        finishRequest(child, status);
+    }
+}
+
+void CompileServer::finishRequest(int child, int status) {
+    auto it = running.find(child);
+    if (it == running.end())
+        return;
+
+    // A crashed request reports like a shell does (128 + signal)
+    int32_t reply = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    try {
+        writeAll(it->second, &reply, sizeof(reply));
+    } catch (const std::runtime_error& e) {
+        LOG_WARNING(e.what());     // The client went away
+    }
+    close(it->second);
+    running.erase(it);
+}
+
+void CompileServer::handleRequest(int connection, const CompileFunction& compile, const char* argv0) {
+
+    // The child is a plain picc process from here on
+    Profiler::getInstance().restartClock();
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+    close(listenFd);
+    close(wakeupPipe[0]);
+    close(wakeupPipe[1]);
+    for (const auto& [pid, fd] : running) {
+        close(fd);
+    }
+
+    // Header: payload size, with the client's standard descriptors attached
+    uint32_t payloadSize = 0;
+    iovec data { &payloadSize, sizeof(payloadSize) };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kPassedDescriptors)];
+    msghdr message {};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (received != sizeof(payloadSize) || !header || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(sizeof(int) * kPassedDescriptors))
+        _exit(1);
+
+    int descriptors[kPassedDescriptors];
+    std::memcpy(descriptors, CMSG_DATA(header), sizeof(descriptors));
+
+    std::string payload(payloadSize, '\0');
+    if (!readAll(connection, payload.data(), payload.size()))
+        _exit(1);
+    close(connection);
+
+    for (int fd = 0; fd < kPassedDescriptors; ++fd) {
+        dup2(descriptors[fd], fd);
+        close(descriptors[fd]);
+    }
+
+    // Payload: cwd, argument count, arguments, environment count, environment
+    std::vector<std::string> fields = splitPayload(payload);
+    size_t argumentCount = fields.size() > 1 ? std::strtoul(fields[1].c_str(), nullptr, 10) : 0;
+    size_t environmentIndex = 2 + argumentCount;
+    if (fields.size() <= environmentIndex)
+        _exit(1);
+
+    if (chdir(fields[0].c_str()) != 0) {
+        std::cerr << "Cannot change to " << fields[0] << ": " << std::strerror(errno) << std::endl;
+        std::exit(1);
+    }
+
+    clearenv();
+    for (size_t i = environmentIndex + 1; i < fields.size(); ++i) {
+        size_t separator = fields[i].find('=');
+        if (separator != std::string::npos)
+            setenv(fields[i].substr(0, separator).c_str(), fields[i].substr(separator + 1).c_str(), 1);
+    }
+
+    std::vector<char*> argv { const_cast<char*>(argv0) };
+    for (size_t i = 2; i < environmentIndex; ++i) {
+        argv.push_back(fields[i].data());
+    }
+    argv.push_back(nullptr);
+
+    int status = compile(static_cast<int>(argv.size() - 1), argv.data());
+
+    // Everything the request wrote is flushed; the static destructors of the
+    // server image have nothing left to do
+    Logger::getInstance().disableAsyncLogging();
+    Logger::getInstance().flush();
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    _exit(status);
+}
+
+std::optional<int> CompileServer::request(const std::string& socketPath, const std::vector<std::string>& args) {
+    int fd = connectTo(socketPath);
+    if (fd < 0)
+        return std::nullopt;
+
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        close(fd);
+        throw std::runtime_error(std::string("Cannot determine the working directory: ") + std::strerror(errno));
+    }
+
+    std::string payload;
+    auto append = [&payload] (const std::string& field) {
+        payload += field;
+        payload += '\0';
+    };
+    append(cwd);
+    append(std::to_string(args.size()));
+    for (const std::string& arg : args) {
+        append(arg);
+    }
+    size_t environmentCount = 0;
+    for (char** entry = environ; *entry; ++entry) {
+        environmentCount++;
+    }
+    append(std::to_string(environmentCount));
+    for (char** entry = environ; *entry; ++entry) {
+        append(*entry);
+    }
+
+    uint32_t payloadSize = static_cast<uint32_t>(payload.size());
+    iovec data { &payloadSize, sizeof(payloadSize) };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kPassedDescriptors)] = {};
+    msghdr message {};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * kPassedDescriptors);
+    int descriptors[kPassedDescriptors] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    std::memcpy(CMSG_DATA(header), descriptors, sizeof(descriptors));
+
+    int32_t status = 0;
+    try {
+        ssize_t sent;
+        do {
+            sent = sendmsg(fd, &message, 0);
+        } while (sent < 0 && errno == EINTR);
+        if (sent != sizeof(payloadSize))
+            throw std::runtime_error(std::string("Cannot send the request: ") + std::strerror(errno));
+        writeAll(fd, payload.data(), payload.size());
+
+        if (!readAll(fd, &status, sizeof(status)))
+            throw std::runtime_error("The compile server closed the connection");
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    return status;
+}
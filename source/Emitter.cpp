@@ -0,0 +1,119 @@
+#include "../include/Emitter.h"
+#include "../include/Logger.h"
+#include "../include/ScopedLogger.h"
+
+#include <cstdlib>
+#include <stdexcept>
+
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FileUtilities.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+Emitter::Emitter(OptLevel level) : targetMachine(Optimizer::createHostTargetMachine(level)) {
+}
+
+std::string Emitter::defaultOutputPath(const std::string& inputPath, OutputKind kind) {
+    if (kind == OutputKind::Executable)
+        return "a.out";
+
+    // foo/bar.pi -> bar.o in the working directory; stdin -> a.o
+    std::string stem = inputPath == "-" ? "a" : sys::path::stem(inputPath).str();
+    switch (kind) {
+        case OutputKind::IR:       return stem + ".ll";
+        case OutputKind::Assembly: return stem + ".s";
+        default:                   return stem + ".o";
+    }
+}
+
+void Emitter::emit(Module& module, OutputKind kind, raw_pwrite_stream& out) {
+    module.setTargetTriple(targetMachine->getTargetTriple().str());
+    module.setDataLayout(targetMachine->createDataLayout());
+
+    CodeGenFileType fileType = kind == OutputKind::Assembly ? CGFT_AssemblyFile : CGFT_ObjectFile;
+
+    legacy::PassManager passes;
+    if (targetMachine->addPassesToEmitFile(passes, out, nullptr, fileType))
+        throw std::runtime_error("The host target cannot emit this file type");
+
+    passes.run(module);
+}
+
+void Emitter::emitFile(Module& module, OutputKind kind, const std::string& path) {
+    LOG_SCOPE_DETAIL("Emit Native Code", path);
+
+    std::error_code error;
+    raw_fd_ostream out(path, error, kind == OutputKind::Assembly ? sys::fs::OF_Text : sys::fs::OF_None);
+    if (error)
+        throw std::runtime_error("Cannot open " + path + ": " + error.message());
+
+    emit(module, kind, out);
+
+    out.flush();
+    if (out.has_error())
+        throw std::runtime_error("Cannot write " + path + ": " + out.error().message());
+
+    LOG_INFO("Wrote " + path);
+}
+
+void Emitter::writeIR(const Module& module, const std::string& path) {
+    LOG_SCOPE_DETAIL("Write IR", path);
+
+    std::error_code error;
+    raw_fd_ostream out(path, error, sys::fs::OF_Text);
+    if (error)
+        throw std::runtime_error("Cannot open " + path + ": " + error.message());
+
+    module.print(out, nullptr);
+
+    out.flush();
+    if (out.has_error())
+        throw std::runtime_error("Cannot write " + path + ": " + out.error().message());
+
+    LOG_INFO("Wrote " + path);
+}
+
+SmallVector<char, 0> Emitter::emitToMemory(Module& module, OutputKind kind) {
+    LOG_SCOPE("Emit Native Code");
+
+    SmallVector<char, 0> code;
+    raw_svector_ostream out(code);
+    emit(module, kind, out);
+    return code;
+}
+
+void Emitter::emitExecutable(Module& module, const std::string& path) {
+    SmallString<128> objectPath;
+    if (std::error_code error = sys::fs::createTemporaryFile("picc", "o", objectPath))
+        throw std::runtime_error("Cannot create a temporary object file: " + error.message());
+
+    // The temporary object is removed on every way out of this function
+    FileRemover removeObject(objectPath);
+
+    emitFile(module, OutputKind::Object, objectPath.str().str());
+    linkExecutable(objectPath.str().str(), path);
+}
+
+void Emitter::linkExecutable(const std::string& objectPath, const std::string& path) {
+    LOG_SCOPE_DETAIL("Link Executable", path);
+
+    const char* driverName = std::getenv("CC");
+    std::string driver = driverName && *driverName ? driverName : "cc";
+    ErrorOr<std::string> driverPath = sys::findProgramByName(driver);
+    if (!driverPath)
+        throw std::runtime_error("Cannot find the linker driver '" + driver + "' (set CC to choose another one)");
+
+    std::vector<StringRef> args { *driverPath, objectPath, "-o", path };
+    std::string message;
+    int status = sys::ExecuteAndWait(*driverPath, args, None, {}, 0, 0, &message);
+    if (status != 0) {
+        throw std::runtime_error("Linking " + path + " failed" +
+                                 (message.empty() ? " (exit code " + std::to_string(status) + ")" : ": " + message));
+    }
+
+    LOG_INFO("Linked " + path);
+}
@@ -0,0 +1,79 @@
+#include "../include/Jit.h"
+#include "../include/Logger.h"
+#include "../include/ScopedLogger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+
+using namespace llvm;
+
+Jit::Jit(OptLevel level, bool timePasses) : level(level), optimizer(level, timePasses) {
+}
+
+int Jit::run(std::vector<Codegen::GeneratedModule> modules, const std::string& entryName) {
+    LOG_SCOPE("JIT Execution");
+
+    Expected<orc::JITTargetMachineBuilder> targetBuilder = orc::JITTargetMachineBuilder::detectHost();
+    if (!targetBuilder)
+        throw std::runtime_error("Host target not available: " + toString(targetBuilder.takeError()));
+
+    CodeGenOpt::Level codegenLevel = CodeGenOpt::None;
+    switch (level) {
+        case OptLevel::O1: codegenLevel = CodeGenOpt::Less; break;
+        case OptLevel::O2: codegenLevel = CodeGenOpt::Default; break;
+        case OptLevel::O3: codegenLevel = CodeGenOpt::Aggressive; break;
+        default: break;
+    }
+    targetBuilder->setCodeGenOptLevel(codegenLevel);
+    targetBuilder->setOptions(Optimizer::targetOptions());
+
+    Expected<std::unique_ptr<orc::LLLazyJIT>> jit = orc::LLLazyJITBuilder()
+        .setJITTargetMachineBuilder(std::move(*targetBuilder))
+        .create();
+    if (!jit)
+        throw std::runtime_error("Cannot create the JIT: " + toString(jit.takeError()));
+
+    // Calls to the C library (puts) are resolved against this process
+    const DataLayout& dataLayout = (*jit)->getDataLayout();
+    auto processSymbols = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(dataLayout.getGlobalPrefix());
+    if (!processSymbols)
+        throw std::runtime_error("Cannot resolve process symbols: " + toString(processSymbols.takeError()));
+    (*jit)->getMainJITDylib().addGenerator(std::move(*processSymbols));
+
+    // Each function is optimized when it is compiled, i.e. on its first call
+    (*jit)->getIRTransformLayer().setTransform(
+        [this] (orc::ThreadSafeModule module, const orc::MaterializationResponsibility&) -> Expected<orc::ThreadSafeModule> {
+            try {
+                module.withModuleDo([this] (Module& partition) { optimizer.run(partition); });
+            } catch (const std::runtime_error& e) {
+                return make_error<StringError>(e.what(), inconvertibleErrorCode());
+            }
+            return module;
+        });
+
+    // Each function becomes its own lazily compiled unit
+    for (Codegen::GeneratedModule& generated : modules) {
+        generated.module->setDataLayout(dataLayout);
+        generated.module->setTargetTriple((*jit)->getTargetTriple().str());
+
+        orc::ThreadSafeModule module(std::move(generated.module), std::move(generated.context));
+        if (Error error = (*jit)->addLazyIRModule(std::move(module)))
+            throw std::runtime_error("Cannot add a module to the JIT: " + toString(std::move(error)));
+    }
+
+    Expected<JITEvaluatedSymbol> entry = (*jit)->lookup(entryName);
+    if (!entry)
+        throw std::runtime_error("Entry point not found: " + toString(entry.takeError()));
+
+    LOG_DEBUG("Calling " + entryName);
+    auto entryFunction = reinterpret_cast<int (*)()>(entry->getAddress());
+    int result = entryFunction();
+
+    // Program output goes before anything picc prints afterwards
+    std::fflush(stdout);
+    return result;
+}
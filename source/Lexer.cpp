@@ -1,13 +1,74 @@
-#include <cctype>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 
+#include "../include/Keywords.h"
 #include "../include/Lexer.h"
 #include "../include/Logger.h"
 #include "../include/ScopedLogger.h"
 
-Lexer::Lexer(const std::string &source) : source(source), index(0), line(1), column(1) {
+Lexer::Lexer(SourceManager &sourceManager)
+    : source(sourceManager.getBuffer()), index(0), kernels(getScanKernels()) {
     LOG_INFO("Initializing Lexer with source code of length: " + std::to_string(source.length()));
+
+    // Token offsets are stored as 32-bit values
+    if (source.size() > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("Source files larger than 4 GiB are not supported: " + sourceManager.getFileName());
+}
+
+namespace {
+
+/// @brief Character classes used by the lexer's dispatch (bit flags)
+enum CharClass : uint8_t {
+    CC_NONE   = 0,
+    CC_SPACE  = 1 << 0,     // ' ', \t, \n, \v, \f, \r
+    CC_ALPHA  = 1 << 1,     // A-Z, a-z (may start an identifier)
+    CC_DIGIT  = 1 << 2,     // 0-9
+    CC_PUNCT  = 1 << 3,     // single character token, see punctuationTable
+    CC_SPECIAL = 1 << 4,    // needs a look at the following characters (' " - / = ! < > .)
+};
+
+constexpr std::array<uint8_t, 256> buildCharClassTable() {
+    std::array<uint8_t, 256> table {};
+    for (char c : {' ', '\t', '\n', '\v', '\f', '\r'})
+        table[static_cast<unsigned char>(c)] = CC_SPACE;
+    for (int c = 'a'; c <= 'z'; ++c) table[c] = CC_ALPHA;
+    for (int c = 'A'; c <= 'Z'; ++c) table[c] = CC_ALPHA;
+    for (int c = '0'; c <= '9'; ++c) table[c] = CC_DIGIT;
+    for (char c : {':', ',', '+', '*', '(', ')', '{', '}', '[', ']'})
+        table[static_cast<unsigned char>(c)] = CC_PUNCT;
+    for (char c : {'\'', '"', '-', '/', '=', '!', '<', '>', '.'})
+        table[static_cast<unsigned char>(c)] = CC_SPECIAL;
+    return table;
+}
+
+constexpr std::array<TokenType, 256> buildPunctuationTable() {
+    std::array<TokenType, 256> table {};
+    for (auto& type : table) type = TOKEN_UNKNOWN;
+    table[':'] = TOKEN_COLON;
+    table[','] = TOKEN_COMMA;
+    table['+'] = TOKEN_PLUS;
+    table['*'] = TOKEN_STAR;
+    table['('] = TOKEN_LPAREN;
+    table[')'] = TOKEN_RPAREN;
+    table['{'] = TOKEN_LBRACE;
+    table['}'] = TOKEN_RBRACE;
+    table['['] = TOKEN_LBRACKET;
+    table[']'] = TOKEN_RBRACKET;
+    return table;
 }
 
+constexpr std::array<uint8_t, 256> charClassTable = buildCharClassTable();
+constexpr std::array<TokenType, 256> punctuationTable = buildPunctuationTable();
+
+inline uint8_t classOf(char c) {
+    return charClassTable[static_cast<unsigned char>(c)];
+}
+
+} // namespace
+
 char Lexer::currentChar() {
     if (index < source.size())
         return source[index];
@@ -15,99 +76,48 @@ char Lexer::currentChar() {
 }
 
 void Lexer::advance() {
-    if (currentChar() == '\n') {
-        line++;
-        column = 1;
-    } else {
-        column++;
-    }
     index++;
 }
 
-std::vector<Token> Lexer::tokenize() {
-
-    LOG_SCOPE("Tokenization");
-
-    std::vector<Token> tokens;
+Token Lexer::next() {
 
     while (index < source.size()) {
 
         char c = currentChar();
+        uint8_t charClass = classOf(c);
 
-        if (isspace(c)) {
-            advance();
+        if (charClass & CC_SPACE) {
+            index = kernels.skipWhitespace(source.data(), source.size(), index);
             continue;
         }
 
-        // Save start position for the current token
-        int tokenLine = line;
-        int tokenColumn = column;
+        // Remember where the token starts; tokens only keep a slice of the source and
+        // their offset, line and column are computed later if a diagnostic needs them
+        size_t tokenStart = index;
+        uint32_t tokenOffset = static_cast<uint32_t>(tokenStart);
 
-        if (isalpha(c)) {
-            std::string word;
+        if (charClass & CC_ALPHA) {
 
-            while (isalnum(currentChar())) {
-                word.push_back(currentChar());
-                advance();
-            }
+            do {
+                index++;
+            } while (index < source.size() && (classOf(source[index]) & (CC_ALPHA | CC_DIGIT)));
 
-            if (word == "func")
-                tokens.push_back({TOKEN_FUNC, word, tokenLine, tokenColumn});
-            else if (word == "return")
-                tokens.push_back({TOKEN_RETURN, word, tokenLine, tokenColumn});
-            else if (word == "start")
-                tokens.push_back({TOKEN_START, word, tokenLine, tokenColumn});
-            else if (word == "print")
-                tokens.push_back({TOKEN_PRINT, word, tokenLine, tokenColumn});
-            else if (word == "const")
-                tokens.push_back({TOKEN_CONST, word, tokenLine, tokenColumn});
-            else if (word == "void")
-                tokens.push_back({TOKEN_VOID, word, tokenLine, tokenColumn});
-
-            // CHARACTER TYPES
-            else if (word == "char8")
-                tokens.push_back({TOKEN_CHAR8, word, tokenLine, tokenColumn});
-            else if (word == "char16")
-                tokens.push_back({TOKEN_CHAR16, word, tokenLine, tokenColumn});
-            else if (word == "char32")
-                tokens.push_back({TOKEN_CHAR32, word, tokenLine, tokenColumn});
-
-            // INTEGER TYPES
-            else if (word == "int8")
-                tokens.push_back({TOKEN_INT8, word, tokenLine, tokenColumn});
-            else if (word == "int16")
-                tokens.push_back({TOKEN_INT16, word, tokenLine, tokenColumn});
-            else if (word == "int32")
-                tokens.push_back({TOKEN_INT32, word, tokenLine, tokenColumn});
-            else if (word == "int64")
-                tokens.push_back({TOKEN_INT64, word, tokenLine, tokenColumn});
-
-            // UNSIGNED INTEGER TYPES
-            else if (word == "uint8")
-                tokens.push_back({TOKEN_UINT8, word, tokenLine, tokenColumn});
-            else if (word == "uint16")
-                tokens.push_back({TOKEN_UINT16, word, tokenLine, tokenColumn});
-            else if (word == "uint32")
-                tokens.push_back({TOKEN_UINT32, word, tokenLine, tokenColumn});
-            else if (word == "uint64")
-                tokens.push_back({TOKEN_UINT64, word, tokenLine, tokenColumn});
-            
-            else
-                tokens.push_back({TOKEN_IDENT, word, tokenLine, tokenColumn});
-            continue;
+            std::string_view word = source.substr(tokenStart, index - tokenStart);
+            return {lookupKeyword(word), word, tokenOffset};
         }
 
-        if (isdigit(c)) {
-
-            std::string number;
+        if (charClass & CC_DIGIT) {
 
-            while (isdigit(currentChar())) {
-                number += currentChar();
-                advance();
-            }
+            do {
+                index++;
+            } while (index < source.size() && (classOf(source[index]) & CC_DIGIT));
             
-            tokens.push_back({TOKEN_NUMBER, number, tokenLine, tokenColumn});
-            continue;
+            return {TOKEN_NUMBER, source.substr(tokenStart, index - tokenStart), tokenOffset};
+        }
+
+        if (charClass & CC_PUNCT) {
+            advance();
+            return {punctuationTable[static_cast<unsigned char>(c)], source.substr(tokenStart, 1), tokenOffset};
         }
 
         if (c == '\'') {
@@ -115,123 +125,108 @@ std::vector<Token> Lexer::tokenize() {
             // skip the opening '
             advance();
             
-            std::string charLiteral;
-
             // optional: handling of escape sequences
             if (currentChar() == '\\') {
                 advance();
-                charLiteral.push_back(currentChar());
-                advance();
-            } else {
-                charLiteral.push_back(currentChar());
-                advance();
             }
 
+            std::string_view charLiteral = source.substr(index, 1);
+            advance();
+
             if (currentChar() != '\'')
                 throw std::runtime_error("Expected closing ' for char literal");
 
             // skip the closing '
             advance();
-            tokens.push_back({TOKEN_CHAR, charLiteral, tokenLine, tokenColumn});
-            continue;
+            return {TOKEN_CHAR, charLiteral, tokenOffset};
         }
 
         if (c == '-') {
             if (index + 1 < source.size() && source[index + 1] == '>') {
-                tokens.push_back({TOKEN_ARROW, "->", tokenLine, tokenColumn});
                 advance(); // skip '-'
                 advance(); // skip '>'
-            } else {
-                tokens.push_back({TOKEN_MINUS, "-", tokenLine, tokenColumn});
-                advance();
+                return {TOKEN_ARROW, source.substr(tokenStart, 2), tokenOffset};
             }
-            continue;
-        }
 
-        if (c == ':') {
-            tokens.push_back({TOKEN_COLON, ":", tokenLine, tokenColumn});
             advance();
-            continue;
+            return {TOKEN_MINUS, source.substr(tokenStart, 1), tokenOffset};
         }
 
-        if (c == '=') {
-            tokens.push_back({TOKEN_ASSIGN, "=", tokenLine, tokenColumn});
-            advance();
-            continue;
-        }
+        if (c == '=' || c == '!' || c == '<' || c == '>') {
+            // A following '=' makes a comparison; a single '=' is the assignment
+            bool withEqual = index + 1 < source.size() && source[index + 1] == '=';
+            TokenType type = TOKEN_UNKNOWN;
+            switch (c) {
+                case '=': type = withEqual ? TOKEN_EQUAL : TOKEN_ASSIGN; break;
+                case '!': type = withEqual ? TOKEN_NOT_EQUAL : TOKEN_UNKNOWN; break;
+                case '<': type = withEqual ? TOKEN_LESS_EQUAL : TOKEN_LESS; break;
+                default:  type = withEqual ? TOKEN_GREATER_EQUAL : TOKEN_GREATER; break;
+            }
 
-        if (c == '+') {
-            tokens.push_back({TOKEN_PLUS, "+", tokenLine, tokenColumn});
-            advance();
-            continue;
+            size_t length = withEqual ? 2 : 1;
+            index += length;
+            return {type, source.substr(tokenStart, length), tokenOffset};
         }
 
-        if (c == '*') {
-            tokens.push_back({TOKEN_STAR, "*", tokenLine, tokenColumn});
+        if (c == '.') {
+            if (index + 1 < source.size() && source[index + 1] == '.') {
+                index += 2;
+                return {TOKEN_DOTDOT, source.substr(tokenStart, 2), tokenOffset};
+            }
+
             advance();
-            continue;
+            return {TOKEN_UNKNOWN, source.substr(tokenStart, 1), tokenOffset};
         }
 
         if (c == '/') {
             if (index + 1 < source.size() && source[index + 1] == '/') {
                 // Comment detected, skip until end of line
-                while (index < source.size() && source[index] != '\n') {
-                    advance();
-                }
+                index = kernels.findEither(source.data(), source.size(), index, '\n', '\n');
                 continue;
             }
 
-            tokens.push_back({TOKEN_SLASH, "/", tokenLine, tokenColumn});
-            advance();
-            continue;
-        }
-
-        if (c == '(') {
-            tokens.push_back({TOKEN_LPAREN, "(", tokenLine, tokenColumn});
-            advance();
-            continue;
-        }
-
-        if (c == ')') {
-            tokens.push_back({TOKEN_RPAREN, ")", tokenLine, tokenColumn});
-            advance();
-            continue;
-        }
-
-        if (c == '{') {
-            tokens.push_back({TOKEN_LBRACE, "{", tokenLine, tokenColumn});
             advance();
-            continue;
-        }
-
-        if (c == '}') {
-            tokens.push_back({TOKEN_RBRACE, "}", tokenLine, tokenColumn});
-            advance();
-            continue;
+            return {TOKEN_SLASH, source.substr(tokenStart, 1), tokenOffset};
         }
 
         if (c == '"') {
-            std::string str;
             advance(); // skip opening quotation mark
 
-            while (currentChar() != '"' && currentChar() != '\0') {
-                str.push_back(currentChar());
-                advance();
-            }
+            index = kernels.findEither(source.data(), source.size(), index, '"', '\0');
 
+            std::string_view str = source.substr(tokenStart + 1, index - tokenStart - 1);
             advance(); // skip closing quotation mark
-            tokens.push_back({TOKEN_STRING, str, tokenLine, tokenColumn});
-            continue;
+            return {TOKEN_STRING, str, tokenOffset};
         }
 
         // Handle unknown characters
-        tokens.push_back({TOKEN_UNKNOWN, std::string(1, c), tokenLine, tokenColumn});
         advance();
+        return {TOKEN_UNKNOWN, source.substr(tokenStart, 1), tokenOffset};
     }
 
-    tokens.push_back({TOKEN_EOF, "", line, column});
+    // Once the source is exhausted every further call yields EOF
+    return {TOKEN_EOF, "", static_cast<uint32_t>(source.size())};
+}
+
+TokenBuffer Lexer::tokenize() {
+
+    LOG_SCOPE("Tokenization");
+
+    TokenBuffer tokens(source);
+
+    // Rough guess (one token per four bytes) to avoid most reallocations
+    tokens.reserve(source.size() / 4 + 1);
+
+    Token token;
+    do {
+        token = next();
+
+        // A token spans from its offset to the current position (the lexer may have stepped past the end)
+        size_t end = std::min(index, source.size());
+        tokens.push(token.type, token.offset, static_cast<uint32_t>(end - token.offset));
+    } while (token.type != TOKEN_EOF);
 
     LOG_INFO("Tokenization completed successfully. Total tokens: " + std::to_string(tokens.size()));
 
     return tokens;
-}
\ No newline at end of file
+}
@@ -0,0 +1,174 @@
+#include <cstdlib>
+#include <string>
+
+#include "../include/LexerScan.h"
+#include "../include/Logger.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PI_SCAN_X86 1
+#endif
+
+namespace {
+
+// --- Scalar kernels (portable fallback, also used for the tails of the vector kernels) ---
+
+inline bool isWhitespace(char c) {
+    // ' ' and the contiguous range \t \n \v \f \r
+    return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+}
+
+size_t skipWhitespaceScalar(const char* data, size_t size, size_t pos) {
+    while (pos < size && isWhitespace(data[pos])) pos++;
+    return pos;
+}
+
+size_t findEitherScalar(const char* data, size_t size, size_t pos, char a, char b) {
+    while (pos < size && data[pos] != a && data[pos] != b) pos++;
+    return pos;
+}
+
+size_t countScalar(const char* data, size_t size, size_t pos, char target) {
+    size_t result = 0;
+    for (; pos < size; ++pos) {
+        if (data[pos] == target) result++;
+    }
+    return result;
+}
+
+#ifdef PI_SCAN_X86
+
+// --- SSE2 kernels (16 bytes per step; SSE2 is part of the x86-64 baseline) ---
+
+__attribute__((target("sse2")))
+inline __m128i whitespaceMask16(__m128i chunk) {
+    // Unsigned (c - '\t') <= 4 covers \t \n \v \f \r
+    __m128i shifted = _mm_sub_epi8(chunk, _mm_set1_epi8('\t'));
+    __m128i inRange = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')), shifted);
+    return _mm_or_si128(inRange, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+}
+
+__attribute__((target("sse2")))
+size_t skipWhitespaceSse2(const char* data, size_t size, size_t pos) {
+    while (pos + 16 <= size) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(whitespaceMask16(chunk)));
+        if (mask != 0xFFFF) return pos + __builtin_ctz(~mask);
+        pos += 16;
+    }
+    return skipWhitespaceScalar(data, size, pos);
+}
+
+__attribute__((target("sse2")))
+size_t findEitherSse2(const char* data, size_t size, size_t pos, char a, char b) {
+    __m128i needleA = _mm_set1_epi8(a);
+    __m128i needleB = _mm_set1_epi8(b);
+    while (pos + 16 <= size) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, needleA), _mm_cmpeq_epi8(chunk, needleB));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+        if (mask != 0) return pos + __builtin_ctz(mask);
+        pos += 16;
+    }
+    return findEitherScalar(data, size, pos, a, b);
+}
+
+__attribute__((target("sse2,popcnt")))
+size_t countSse2(const char* data, size_t size, size_t pos, char target) {
+    __m128i needle = _mm_set1_epi8(target);
+    size_t result = 0;
+    while (pos + 16 <= size) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        result += __builtin_popcount(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle))));
+        pos += 16;
+    }
+    return result + countScalar(data, size, pos, target);
+}
+
+// --- AVX2 kernels (32 bytes per step) ---
+
+__attribute__((target("avx2")))
+inline __m256i whitespaceMask32(__m256i chunk) {
+    __m256i shifted = _mm256_sub_epi8(chunk, _mm256_set1_epi8('\t'));
+    __m256i inRange = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8('\r' - '\t')), shifted);
+    return _mm256_or_si256(inRange, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')));
+}
+
+__attribute__((target("avx2")))
+size_t skipWhitespaceAvx2(const char* data, size_t size, size_t pos) {
+    while (pos + 32 <= size) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(whitespaceMask32(chunk)));
+        if (mask != 0xFFFFFFFFu) return pos + __builtin_ctz(~mask);
+        pos += 32;
+    }
+    return skipWhitespaceSse2(data, size, pos);
+}
+
+__attribute__((target("avx2")))
+size_t findEitherAvx2(const char* data, size_t size, size_t pos, char a, char b) {
+    __m256i needleA = _mm256_set1_epi8(a);
+    __m256i needleB = _mm256_set1_epi8(b);
+    while (pos + 32 <= size) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, needleA), _mm256_cmpeq_epi8(chunk, needleB));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+        if (mask != 0) return pos + __builtin_ctz(mask);
+        pos += 32;
+    }
+    return findEitherSse2(data, size, pos, a, b);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t countAvx2(const char* data, size_t size, size_t pos, char target) {
+    __m256i needle = _mm256_set1_epi8(target);
+    size_t result = 0;
+    while (pos + 32 <= size) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        result += __builtin_popcount(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle))));
+        pos += 32;
+    }
+    return result + countSse2(data, size, pos, target);
+}
+
+#endif // PI_SCAN_X86
+
+const ScanKernels scalarKernels { "scalar", skipWhitespaceScalar, findEitherScalar, countScalar };
+
+#ifdef PI_SCAN_X86
+const ScanKernels sse2Kernels { "sse2", skipWhitespaceSse2, findEitherSse2, countSse2 };
+const ScanKernels avx2Kernels { "avx2", skipWhitespaceAvx2, findEitherAvx2, countAvx2 };
+#endif
+
+const ScanKernels& selectScanKernels() {
+
+    const char* override = std::getenv("PICC_LEXER_KERNELS");
+    std::string requested = override ? override : "";
+
+    if (requested == "scalar")
+        return scalarKernels;
+
+#ifdef PI_SCAN_X86
+    __builtin_cpu_init();
+    bool hasAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    bool hasSse2 = __builtin_cpu_supports("sse2") && __builtin_cpu_supports("popcnt");
+
+    if (hasAvx2 && (requested.empty() || requested == "avx2"))
+        return avx2Kernels;
+    if (hasSse2 && (requested.empty() || requested == "sse2" || requested == "avx2"))
+        return sse2Kernels;
+#endif
+
+    return scalarKernels;
+}
+
+} // namespace
+
+const ScanKernels& getScanKernels() {
+    static const ScanKernels& kernels = [] () -> const ScanKernels& {
+        const ScanKernels& selected = selectScanKernels();
+        LOG_DEBUG(std::string("Lexer scan kernels: ") + selected.name);
+        return selected;
+    }();
+    return kernels;
+}
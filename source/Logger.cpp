@@ -1,3 +1,7 @@
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+
 #include "../include/Logger.h"
 
 Logger& Logger::getInstance() {
@@ -6,10 +10,12 @@ Logger& Logger::getInstance() {
 }
 
 Logger::Logger() : currentLogLevel(LogLevel::INFO) {
-    appStartTime = std::chrono::steady_clock::now();
 }
 
 Logger::~Logger() {
+    // Exit guarantee: everything still queued reaches the streams
+    disableAsyncLogging();
+
     if (logFile.is_open()) {
         logFile.close();
     }
@@ -19,7 +25,8 @@ void Logger::setLogLevel(LogLevel level) {
     currentLogLevel = level;
 }
 
-void Logger::enableFileLogging(const std::string& filename) {
+void Logger::enableFileLogging(const std::string& filename, LogLevel level) {
+    flush();
     std::lock_guard<std::mutex> lock(logMutex);
 
     if (logFile.is_open()) {
@@ -27,16 +34,137 @@ void Logger::enableFileLogging(const std::string& filename) {
     }
 
     logFile.open(filename, std::ios::app);
+    logFileName = filename;
+    fileLogLevel = level;
+
+    // Appending: rotation has to account for what is already in the file
+    logFile.seekp(0, std::ios::end);
+    std::streamoff size = logFile.tellp();
+    logFileSize = size > 0 ? static_cast<size_t>(size) : 0;
+
+    fileLoggingEnabled = logFile.is_open();
 }
 
 void Logger::disableFileLogging() {
+    flush();
     std::lock_guard<std::mutex> lock(logMutex);
 
+    fileLoggingEnabled = false;
     if (logFile.is_open()) {
         logFile.close();
     }
 }
 
+void Logger::setFileRotation(size_t maxBytes, int maxFiles) {
+    std::lock_guard<std::mutex> lock(logMutex);
+    maxLogFileBytes = maxBytes;
+    maxLogFiles = maxFiles;
+}
+
+void Logger::rotateLogFile() {
+    logFile.close();
+
+    // name.(n-1) -> name.n, ..., name -> name.1; the oldest file is overwritten
+    for (int i = maxLogFiles - 1; i >= 1; --i) {
+        std::string from = logFileName + "." + std::to_string(i);
+        std::string to = logFileName + "." + std::to_string(i + 1);
+        std::rename(from.c_str(), to.c_str());
+    }
+    if (maxLogFiles > 0) {
+        std::rename(logFileName.c_str(), (logFileName + ".1").c_str());
+    }
+
+    logFile.open(logFileName, std::ios::trunc);
+    logFileSize = 0;
+}
+
+void Logger::enableAsyncLogging(size_t capacity) {
+    if (asyncEnabled) return;
+
+    ringBuffer = std::make_unique<LogRingBuffer>(capacity);
+    recordsWritten = 0;
+    stopWriter = false;
+    writerThread = std::thread(&Logger::writerLoop, this);
+    asyncEnabled = true;
+}
+
+void Logger::disableAsyncLogging() {
+    if (!asyncEnabled) return;
+
+    // Must not race with other threads that are still logging
+
+    // New records go the synchronous way from now on; the writer drains the rest
+    asyncEnabled = false;
+    stopWriter = true;
+    wakeWriter();
+    writerThread.join();
+    ringBuffer.reset();
+}
+
+void Logger::flush() {
+    if (!asyncEnabled) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        if (logFile.is_open()) logFile.flush();
+        std::cerr.flush();
+        return;
+    }
+
+    // Wait until the writer has caught up with everything pushed so far
+    LogRecord marker { LogLevel::TRACE, false, true, "" };
+    size_t position = 0;
+    while (!ringBuffer->tryPush(marker, position)) {
+        std::this_thread::yield();
+    }
+    wakeWriter();
+    while (recordsWritten.load(std::memory_order_acquire) <= position) {
+        std::this_thread::yield();
+    }
+}
+
+void Logger::writerLoop() {
+    constexpr size_t kBatchSize = 1024;
+    auto idleSleep = std::chrono::microseconds(50);
+
+    LogRecord record;
+    while (true) {
+        size_t written = 0;
+        {
+            std::lock_guard<std::mutex> lock(logMutex);
+            while (written < kBatchSize && ringBuffer->tryPop(record)) {
+                writeRecord(record);
+                written++;
+            }
+
+            // One flush per batch instead of one per line
+            if (written > 0) {
+                std::cerr.flush();
+                if (logFile.is_open()) logFile.flush();
+            }
+        }
+
+        if (written > 0) {
+            recordsWritten.fetch_add(written, std::memory_order_release);
+            idleSleep = std::chrono::microseconds(50);
+            continue;
+        }
+
+        if (stopWriter) break;
+
+        std::unique_lock<std::mutex> lock(wakeupMutex);
+        writerWakeup.wait_for(lock, idleSleep, [this] () { return wakeupRequested; });
+        wakeupRequested = false;
+        idleSleep = std::min(idleSleep * 2, std::chrono::microseconds(2000));
+    }
+}
+
+void Logger::wakeWriter() {
+    {
+        std::lock_guard<std::mutex> lock(wakeupMutex);
+        wakeupRequested = true;
+    }
+    writerWakeup.notify_one();
+}
+
 // Thread-local indentation level
 thread_local int g_indentationLevel = 0;
 
@@ -54,102 +182,29 @@ int Logger::getIndentation() const {
     return g_indentationLevel;
 }
 
-void Logger::registerScopeStart(const std::string& scopeName) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    
-    // If this is the first time we see this scope, add it to insertion order
-    if (scopeStatsMap.find(scopeName) == scopeStatsMap.end()) {
-        insertionOrder.push_back(scopeName);
-        // Initialize stats entry so it exists
-        scopeStatsMap[scopeName] = ScopeStats(); 
-    }
-}
-
-void Logger::recordScopeDuration(const std::string& scopeName, double durationMs, bool isRoot) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    
-    scopeStatsMap[scopeName].totalDurationMs += durationMs;
-    scopeStatsMap[scopeName].count++;
-    scopeStatsMap[scopeName].isRoot = isRoot;
-}
-
-void Logger::printPerformanceSummary() {
-    std::lock_guard<std::mutex> lock(logMutex);
-    
-    auto now = std::chrono::steady_clock::now();
-    double totalAppTimeMs = std::chrono::duration<double, std::milli>(now - appStartTime).count();
-
-    // Calculate sum of root scopes
-    double rootScopesTotalTime = 0.0;
-    for (const auto& pair : scopeStatsMap) {
-        if (pair.second.isRoot) {
-            rootScopesTotalTime += pair.second.totalDurationMs;
-        }
-    }
-    
-    // Calculate overhead
-    double overheadTime = totalAppTimeMs - rootScopesTotalTime;
-    if (overheadTime < 0) overheadTime = 0; // Should not happen unless clock drift or parallel issues
-
-    std::stringstream summary;
-    summary << "\n================================================================================\n";
-    summary << "                         PERFORMANCE SUMMARY                                    \n";
-    summary << "--------------------------------------------------------------------------------\n";
-    summary << " Total Application Time: " << std::fixed << std::setprecision(3) << totalAppTimeMs << " ms\n";
-    summary << "--------------------------------------------------------------------------------\n";
-    summary << std::left << std::setw(40) << " Phase / Scope" 
-            << std::right << std::setw(12) << "Count" 
-            << std::right << std::setw(15) << "Total Time" 
-            << std::right << std::setw(10) << "% App" << "\n";
-    summary << "--------------------------------------------------------------------------------\n";
-
-    // Print tracked scopes in insertion order (ONLY ROOTS)
-    for (const auto& name : insertionOrder) {
-        if (scopeStatsMap.find(name) == scopeStatsMap.end()) continue;
-        const ScopeStats& stats = scopeStatsMap.at(name);
-        
-        if (!stats.isRoot) continue; // Skip nested details for clearer summary
-
-        double percent = (stats.totalDurationMs / totalAppTimeMs) * 100.0;
-
-        summary << std::left << std::setw(40) << name 
-                << std::right << std::setw(12) << stats.count 
-                << std::right << std::setw(12) << std::fixed << std::setprecision(3) << stats.totalDurationMs << " ms" 
-                << std::right << std::setw(9) << std::fixed << std::setprecision(2) << percent << "%\n";
-    }
-
-    // Print Overhead
-    double overheadPercent = (overheadTime / totalAppTimeMs) * 100.0;
-    summary << std::left << std::setw(40) << "Other / Overhead" 
-            << std::right << std::setw(12) << "-" 
-            << std::right << std::setw(12) << std::fixed << std::setprecision(3) << overheadTime << " ms" 
-            << std::right << std::setw(9) << std::fixed << std::setprecision(2) << overheadPercent << "%\n";
-
-    summary << "================================================================================\n";
-
-    // Print to console
-    std::cerr << summary.str();
-
-    // Print to file if enabled
-    if (logFile.is_open()) {
-        logFile << summary.str();
-    }
+void Logger::output(const std::string& text) {
+    submit({ LogLevel::INFO, true, true, text });
 }
 
-#include <iomanip>
-#include <filesystem>
-
 std::string Logger::getCurrentTimestamp() {
     using namespace std::chrono;
     auto now = system_clock::now();
     auto time = system_clock::to_time_t(now);
     auto ms = duration_cast<milliseconds>(now.time_since_epoch()) % 1000;
 
-    std::stringstream stringStream;
-    stringStream << std::put_time(std::localtime(&time), "%H:%M:%S");
-    stringStream << '.' << std::setfill('0') << std::setw(3) << ms.count();
-    
-    return stringStream.str();
+    // Converting to local time is expensive; redo it only when the second changes
+    thread_local std::time_t cachedTime = -1;
+    thread_local char cachedClock[16] = "";
+    if (time != cachedTime) {
+        std::tm localTime;
+        localtime_r(&time, &localTime);
+        std::strftime(cachedClock, sizeof(cachedClock), "%H:%M:%S", &localTime);
+        cachedTime = time;
+    }
+
+    char timestamp[24];
+    std::snprintf(timestamp, sizeof(timestamp), "%s.%03d", cachedClock, static_cast<int>(ms.count()));
+    return timestamp;
 }
 
 std::string Logger::getLogLevelString(LogLevel level) {
@@ -177,35 +232,78 @@ std::string Logger::getColorCode(LogLevel level) {
 }
 
 void Logger::writeLog(LogLevel level, const std::string& message,  const std::string& file, int line) {
-    std::lock_guard<std::mutex> lock(logMutex);
 
-    std::string timestamp = getCurrentTimestamp();
-    std::string levelStr = getLogLevelString(level);
+    bool toConsole = level >= currentLogLevel.load(std::memory_order_relaxed);
+    bool toFile = fileLoggingEnabled.load(std::memory_order_relaxed) && level >= fileLogLevel.load(std::memory_order_relaxed);
+    if (!toConsole && !toFile)
+        return;
 
     // Extract filename from path
-    std::string filename = std::filesystem::path(file).filename().string();
-    std::string location = filename + ":" + std::to_string(line);
+    size_t slash = file.find_last_of("/\\");
+    std::string location = (slash == std::string::npos ? file : file.substr(slash + 1)) + ":" + std::to_string(line);
+    if (location.size() < 28)
+        location.resize(28, ' ');
+
+    LogRecord record { level, toConsole, false, "" };
+    record.toFile = toFile;
+    std::string& entry = record.text;
+    entry.reserve(64 + location.size() + message.size());
+    entry += getCurrentTimestamp();
+    entry += " | ";
+    entry += getLogLevelString(level);
+    entry += " | ";
+    entry += location;
+    entry += " | ";
+    entry.append(g_indentationLevel * 2, ' ');     // 2 spaces per level
+    entry += message;
+
+    submit(std::move(record));
+
+    // Critical messages must not be lost if the process goes down right after
+    if (level == LogLevel::CRITICAL)
+        flush();
+}
 
-    // Create indentation string (2 spaces per level)
-    std::string indentation(g_indentationLevel * 2, ' ');
+void Logger::submit(LogRecord record) {
+    if (asyncEnabled.load(std::memory_order_acquire)) {
+        size_t position = 0;
+        while (!ringBuffer->tryPush(record, position)) {
+            // Full: wait for the writer instead of dropping the record
+            std::this_thread::yield();
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(logMutex);
+    writeRecord(record);
 
-    std::stringstream formattedEntry;
-    formattedEntry << timestamp << " | "
-                   << levelStr << " | "
-                   << std::left << std::setw(28) << location << " | "
-                   << indentation << message;
+    if (record.level >= LogLevel::WARNING && logFile.is_open())
+        logFile.flush();
+}
+
+void Logger::writeRecord(const LogRecord& record) {
+
+    // Flush markers carry no text
+    if (record.raw && record.text.empty())
+        return;
 
     // Console entry (with colors)
-    if (level >= currentLogLevel) {
-        std::string color = getColorCode(level);
-        std::string reset = "\033[0m";
-        
-        std::cerr << color << formattedEntry.str() << reset << std::endl;
+    if (record.toConsole) {
+        if (record.raw)
+            std::cerr << record.text;
+        else
+            std::cerr << getColorCode(record.level) << record.text << "\033[0m\n";
     }
 
     // File logging if enabled
-    if (logFile.is_open()) {
-        logFile << formattedEntry.str() << std::endl;
+    if (record.toFile && logFile.is_open()) {
+        size_t length = record.text.size() + (record.raw ? 0 : 1);
+        if (maxLogFileBytes > 0 && logFileSize > 0 && logFileSize + length > maxLogFileBytes)
+            rotateLogFile();
+
+        logFile << record.text;
+        if (!record.raw) logFile << '\n';
+        logFileSize += length;
     }
 }
 
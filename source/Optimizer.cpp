@@ -0,0 +1,188 @@
+#include "../include/Optimizer.h"
+#include "../include/Logger.h"
+#include "../include/ScopedLogger.h"
+
+#include <stdexcept>
+
+#include <llvm/ADT/Any.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/DiagnosticPrinter.h>
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/Host.h>
+
+using namespace llvm;
+
+namespace {
+
+/// @brief The function a pass runs on, if any (shown with the span in the trace)
+std::string describeUnit(const Any& unit) {
+    if (any_isa<const Function*>(unit))
+        return any_cast<const Function*>(unit)->getName().str();
+    if (any_isa<const Loop*>(unit))
+        return any_cast<const Loop*>(unit)->getHeader()->getParent()->getName().str();
+    return {};
+}
+
+OptimizationLevel toPassBuilderLevel(OptLevel level) {
+    switch (level) {
+        case OptLevel::O1: return OptimizationLevel::O1;
+        case OptLevel::O2: return OptimizationLevel::O2;
+        case OptLevel::O3: return OptimizationLevel::O3;
+        default: return OptimizationLevel::O0;
+    }
+}
+
+/// @brief Sends the diagnostics of the passes to the log (LLVM prints them on stderr)
+struct LoggingDiagnosticHandler : DiagnosticHandler {
+    bool handleDiagnostics(const DiagnosticInfo& info) override {
+        if (info.getSeverity() == DS_Error)
+            return false;
+
+        // e.g. a loop hint the vectorizer could not follow
+        std::string message;
+        raw_string_ostream out(message);
+        DiagnosticPrinterRawOStream printer(out);
+        info.print(printer);
+        LOG_DEBUG("Optimizer: " + out.str());
+        return true;
+    }
+};
+
+} // namespace
+
+struct Optimizer::Pipeline {
+    std::unique_ptr<TargetMachine> targetMachine;
+    PassInstrumentationCallbacks callbacks;
+    LoopAnalysisManager loopAnalyses;
+    FunctionAnalysisManager functionAnalyses;
+    CGSCCAnalysisManager cgsccAnalyses;
+    ModuleAnalysisManager moduleAnalyses;
+    std::unique_ptr<PassBuilder> passBuilder;
+};
+
+Optimizer::Optimizer(OptLevel level, bool timePasses) : level(level), timePasses(timePasses) {
+}
+
+Optimizer::~Optimizer() = default;
+
+TargetOptions Optimizer::targetOptions() {
+    TargetOptions options;
+    options.GuaranteedTailCallOpt = true;
+    return options;
+}
+
+std::unique_ptr<TargetMachine> Optimizer::createHostTargetMachine(OptLevel level) {
+    std::string triple = sys::getDefaultTargetTriple();
+    std::string error;
+    const Target* target = TargetRegistry::lookupTarget(triple, error);
+    if (!target)
+        throw std::runtime_error("Host target not available: " + error);
+
+    CodeGenOpt::Level codegenLevel = CodeGenOpt::None;
+    switch (level) {
+        case OptLevel::O1: codegenLevel = CodeGenOpt::Less; break;
+        case OptLevel::O2: codegenLevel = CodeGenOpt::Default; break;
+        case OptLevel::O3: codegenLevel = CodeGenOpt::Aggressive; break;
+        default: break;
+    }
+
+    // Position independent code, so the objects link into PIE executables
+    return std::unique_ptr<TargetMachine>(target->createTargetMachine(
+        triple, sys::getHostCPUName(), "", targetOptions(), Reloc::PIC_, None, codegenLevel));
+}
+
+void Optimizer::beginPass(StringRef name, std::string detail) {
+    auto it = passSites.find(name.str());
+    if (it == passSites.end())
+        it = passSites.emplace(name.str(), &Profiler::getInstance().getDynamicSite(name.str())).first;
+
+    uint32_t node = Profiler::getInstance().enter(*it->second);
+    running.push_back({ node, Profiler::now(), std::move(detail) });
+}
+
+void Optimizer::endPass() {
+    if (running.empty())
+        return;
+
+    const RunningPass& pass = running.back();
+    Profiler::getInstance().leave(pass.node, pass.startNs, pass.detail);
+    running.pop_back();
+}
+
+void Optimizer::buildPipeline() {
+    pipeline = std::make_unique<Pipeline>();
+    pipeline->targetMachine = createHostTargetMachine(level);
+
+    // Pass timing: every pass and analysis becomes a nested profiler scope
+    PassInstrumentationCallbacks& callbacks = pipeline->callbacks;
+    if (timePasses) {
+        callbacks.registerBeforeNonSkippedPassCallback([this] (StringRef name, Any unit) {
+            beginPass(name, describeUnit(unit));
+        });
+        callbacks.registerAfterPassCallback([this] (StringRef, Any, const PreservedAnalyses&) {
+            endPass();
+        });
+        callbacks.registerAfterPassInvalidatedCallback([this] (StringRef, const PreservedAnalyses&) {
+            endPass();
+        });
+        callbacks.registerBeforeAnalysisCallback([this] (StringRef name, Any unit) {
+            beginPass(name, describeUnit(unit));
+        });
+        callbacks.registerAfterAnalysisCallback([this] (StringRef, Any) {
+            endPass();
+        });
+    }
+
+    // Vectorization is enabled from O2 on, as in clang
+    PipelineTuningOptions tuning;
+    tuning.LoopVectorization = level >= OptLevel::O2;
+    tuning.SLPVectorization = level >= OptLevel::O2;
+
+    pipeline->passBuilder = std::make_unique<PassBuilder>(pipeline->targetMachine.get(), tuning, None,
+                                                          timePasses ? &callbacks : nullptr);
+    PassBuilder& passBuilder = *pipeline->passBuilder;
+    passBuilder.registerModuleAnalyses(pipeline->moduleAnalyses);
+    passBuilder.registerCGSCCAnalyses(pipeline->cgsccAnalyses);
+    passBuilder.registerFunctionAnalyses(pipeline->functionAnalyses);
+    passBuilder.registerLoopAnalyses(pipeline->loopAnalyses);
+    passBuilder.crossRegisterProxies(pipeline->loopAnalyses, pipeline->functionAnalyses,
+                                     pipeline->cgsccAnalyses, pipeline->moduleAnalyses);
+}
+
+void Optimizer::run(Module& module) {
+    if (level == OptLevel::O0)
+        return;
+
+    LOG_SCOPE("Optimization");
+
+    if (!pipeline)
+        buildPipeline();
+
+    module.setTargetTriple(pipeline->targetMachine->getTargetTriple().str());
+    module.setDataLayout(pipeline->targetMachine->createDataLayout());
+
+    // The pass manager itself is built per module: the inliner wrapper extends
+    // its nested pipeline on every run, so a reused one would grow
+    ModulePassManager passes = pipeline->passBuilder->buildPerModuleDefaultPipeline(toPassBuilderLevel(level));
+
+    LOG_DEBUG("Running the O" + std::to_string(static_cast<int>(level)) + " pipeline on " + module.getModuleIdentifier());
+    LLVMContext& context = module.getContext();
+    std::unique_ptr<DiagnosticHandler> previousHandler = context.getDiagnosticHandler();
+    context.setDiagnosticHandler(std::make_unique<LoggingDiagnosticHandler>());
+    passes.run(module, pipeline->moduleAnalyses);
+    context.setDiagnosticHandler(std::move(previousHandler));
+
+    // Cached results refer to this module; the next run starts from scratch
+    pipeline->loopAnalyses.clear();
+    pipeline->functionAnalyses.clear();
+    pipeline->cgsccAnalyses.clear();
+    pipeline->moduleAnalyses.clear();
+
+    // Scopes of a pass that did not report its end (none expected) must not leak
+    while (!running.empty()) {
+        endPass();
+    }
+}
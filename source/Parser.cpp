@@ -1,27 +1,120 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <optional>
 #include <stdexcept>
 
+#include <llvm/Support/ThreadPool.h>
+
 #include "../include/Logger.h"
+#include "../include/Profiler.h"
 #include "../include/ScopedLogger.h"
 #include "../include/Parser.h"
 #include "../include/Token.h"
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), index(0) {
-    // Explicitly ensure an EOF token exists at the end
-    if (this->tokens.empty() || this->tokens.back().type != TOKEN_EOF) {
-        // Use last token's line info if available, else placeholders
-        int line = -1;
-        int col = -1;
-        if (!this->tokens.empty()) {
-            line = this->tokens.back().line;
-            col = this->tokens.back().column; // technically + length but this is fine
+Parser::Parser(TokenSource& source, const SourceManager& sourceManager, Ast& ast)
+    : source(source), sourceManager(sourceManager), ast(ast), index(0), pulled(0) {
+    fill(0);
+    LOG_INFO("Initializing Parser (tokens are pulled on demand)");
+}
+
+std::vector<size_t> Parser::findFunctionBoundaries(const TokenBuffer& tokens) {
+    std::vector<size_t> boundaries { 0 };
+
+    // A 'func' outside of any braces starts a new definition, or the 'export'
+    // before it. Stray closing braces must not hide the following functions,
+    // so the depth stays >= 0
+    size_t depth = 0;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        switch (tokens.kind(i)) {
+            case TOKEN_LBRACE:
+                depth++;
+                break;
+            case TOKEN_RBRACE:
+                if (depth > 0) depth--;
+                break;
+            case TOKEN_EXPORT:
+                if (depth == 0 && i > 0) boundaries.push_back(i);
+                break;
+            case TOKEN_FUNC:
+                if (depth == 0 && i > 0 && tokens.kind(i - 1) != TOKEN_EXPORT) boundaries.push_back(i);
+                break;
+            default:
+                break;
         }
-        this->tokens.push_back({TOKEN_EOF, "", line, col});
     }
-    LOG_INFO("Initializing Parser with " + std::to_string(this->tokens.size()) + " tokens");
+    return boundaries;
+}
+
+bool Parser::parseInParallel(SourceManager& sourceManager, Ast& ast, unsigned jobs) {
+
+    // Tokenizing is serial: a lexical error has to be reported at its place
+    // among the syntax errors
+    TokenBuffer tokens(sourceManager.getBuffer());
+    try {
+        Lexer lexer(sourceManager);
+        tokens = lexer.tokenize();
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+
+    std::vector<size_t> boundaries = findFunctionBoundaries(tokens);
+
+    // Like code generation, a few slices per thread even out functions of different size
+    size_t sliceCount = std::min(boundaries.size(), static_cast<size_t>(jobs) * 4);
+    std::vector<Ast> slices(sliceCount);
+    std::vector<char> failed(sliceCount, 0);
+
+    LOG_DEBUG("Parsing " + std::to_string(boundaries.size()) + " slices in " +
+              std::to_string(sliceCount) + " groups on " + std::to_string(jobs) + " threads");
+    {
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+        for (size_t slice = 0; slice < sliceCount; ++slice) {
+            pool.async([&, slice] () {
+                Profiler::getInstance().setThreadName("parse worker");
+
+                size_t first = boundaries.size() * slice / sliceCount;
+                size_t last = boundaries.size() * (slice + 1) / sliceCount;
+                size_t begin = boundaries[first];
+                size_t end = last < boundaries.size() ? boundaries[last] : tokens.size();
+
+                try {
+                    TokenBufferSource source(tokens, begin, end);
+                    Parser parser(source, sourceManager, slices[slice]);
+                    while (!parser.isAtEOF()) {
+                        parser.parseFunction();
+                    }
+                } catch (const std::exception&) {
+                    failed[slice] = 1;
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end())
+        return false;
+
+    LOG_SCOPE("Merge Slices");
+    for (const Ast& slice : slices) {
+        ast.append(slice);
+    }
+    return true;
+}
+
+const Token& Parser::tokenAt(size_t pos) const {
+    return ring[pos & (kRingSize - 1)];
+}
+
+void Parser::fill(size_t pos) {
+    while (pulled <= pos) {
+        ring[pulled & (kRingSize - 1)] = source.next();
+        pulled++;
+    }
 }
 
 const Token& Parser::currentToken() const {
-    return tokens[index];
+    return tokenAt(index);
 }
 
 bool Parser::isAtEOF() const {
@@ -31,16 +124,31 @@ bool Parser::isAtEOF() const {
 void Parser::advance() {
     if (!isAtEOF()) {
         index++;
+        fill(index);
     }
 }
 
 const Token& Parser::peek() const {
-    return tokens[index];
+    return tokenAt(index);
+}
+
+const Token& Parser::peekAhead(size_t distance) {
+    // Keep the previous token inside the window
+    if (distance > kRingSize - 2)
+        throw std::logic_error("Parser lookahead exceeds the token window");
+
+    fill(index + distance);
+    return tokenAt(index + distance);
 }
 
 const Token& Parser::previous() const {
-    if (index > 0) return tokens[index - 1];
-    return tokens[0];
+    if (index > 0) return tokenAt(index - 1);
+    return tokenAt(0);
+}
+
+std::string Parser::describeLocation(const Token& token) const {
+    SourceLocation location = sourceManager.getLocation(token.offset);
+    return "Line " + std::to_string(location.line) + ", column " + std::to_string(location.column);
 }
 
 bool Parser::check(TokenType type) const {
@@ -63,60 +171,137 @@ const Token& Parser::consume(TokenType type, const std::string& message) {
         advance();
         return previous();
     }
+    syntaxError(message);
+}
 
+void Parser::syntaxError(const std::string& message) const {
     const Token& token = currentToken();
     std::string fullError = "Syntax Error\n" +
         message + "\n" +
-        "Line " + std::to_string(token.line) + ", column " + std::to_string(token.column) + "\n" +
-        "Encountered: \"" + token.lexeme + "\"\n";
+        describeLocation(token) + "\n" +
+        "Encountered: \"" + std::string(token.lexeme) + "\"\n";
 
     throw std::runtime_error(fullError);
 }
 
-std::string Parser::parseType() {
-    if (match({TOKEN_CHAR8, TOKEN_CHAR16, TOKEN_CHAR32,
-               TOKEN_INT8, TOKEN_INT16, TOKEN_INT32, TOKEN_INT64,
-               TOKEN_UINT8, TOKEN_UINT16, TOKEN_UINT32, TOKEN_UINT64,
-               TOKEN_VOID})) {
-        return previous().lexeme;
+TypeId Parser::parseType() {
+    switch (currentToken().type) {
+        case TOKEN_CHAR8:  advance(); return types::Char8;
+        case TOKEN_CHAR16: advance(); return types::Char16;
+        case TOKEN_CHAR32: advance(); return types::Char32;
+        case TOKEN_INT8:   advance(); return types::Int8;
+        case TOKEN_INT16:  advance(); return types::Int16;
+        case TOKEN_INT32:  advance(); return types::Int32;
+        case TOKEN_INT64:  advance(); return types::Int64;
+        case TOKEN_UINT8:  advance(); return types::Uint8;
+        case TOKEN_UINT16: advance(); return types::Uint16;
+        case TOKEN_UINT32: advance(); return types::Uint32;
+        case TOKEN_UINT64: advance(); return types::Uint64;
+        case TOKEN_VOID:   advance(); return types::Void;
+        case TOKEN_LBRACKET: return parseAggregateType();
+        case TOKEN_IDENT:
+            if (currentToken().lexeme.substr(0, 3) == "vec") return parseVectorType();
+            break;
+        default: break;
     }
-    throw std::runtime_error("Expected type (e.g. void, char8, char16, char32, int8, int16, int32, int64) after symbol");
+    throw std::runtime_error("Expected type (e.g. void, char8, char16, char32, int8, int16, int32, int64, [4]int32, []int32, vec4<int32>) after symbol");
 }
 
-std::unique_ptr<FuncNode> Parser::parseFunction() {
+TypeId Parser::parseAggregateType() {
+    // [N]T is an array of N elements, []T a slice
+    consume(TOKEN_LBRACKET, "Expected '[' to start an array or slice type");
+
+    std::optional<uint64_t> length;
+    if (match({TOKEN_NUMBER})) {
+        const Token& lengthToken = previous();
+        uint64_t value = 0;
+        const char* first = lengthToken.lexeme.data();
+        const char* last = first + lengthToken.lexeme.size();
+        if (std::from_chars(first, last, value).ec != std::errc() || value == 0)
+            syntaxError("Array length must be a positive integer");
+        length = value;
+    }
+    consume(TOKEN_RBRACKET, length ? "Expected ']' after array length" : "Expected array length or ']'");
+
+    TypeTable& typeTable = TypeTable::getInstance();
+    TypeId element = parseType();
+    const TypeInfo& info = typeTable.get(element);
+    if (info.kind != TypeKind::Integer && info.kind != TypeKind::Char)
+        throw std::runtime_error("Syntax Error\nLine " + std::to_string(sourceManager.getLocation(previous().offset).line) +
+                                 ": Array and slice elements must have an integer or character type, not " + info.name);
+
+    return length ? typeTable.getArray(element, *length) : typeTable.getSlice(element);
+}
+
+TypeId Parser::parseVectorType() {
+    // vecN<T> has N lanes of the integer type T; N is part of the name
+    std::string_view spelling = currentToken().lexeme;
+    uint64_t lanes = 0;
+    const char* first = spelling.data() + 3;
+    const char* last = spelling.data() + spelling.size();
+    auto [end, error] = std::from_chars(first, last, lanes);
+    if (error != std::errc() || end != last || lanes < 2 || lanes > 64 || (lanes & (lanes - 1)) != 0)
+        syntaxError("Vector types have 2, 4, 8, 16, 32 or 64 lanes (e.g. vec4<int32>)");
+    advance();
+    consume(TOKEN_LESS, "Expected '<' after the number of lanes");
+
+    TypeTable& typeTable = TypeTable::getInstance();
+    TypeId element = parseType();
+    const TypeInfo& info = typeTable.get(element);
+    if (info.kind != TypeKind::Integer)
+        throw std::runtime_error("Syntax Error\nLine " + std::to_string(sourceManager.getLocation(previous().offset).line) +
+                                 ": Vector lanes must have an integer type, not " + info.name);
+    consume(TOKEN_GREATER, "Expected '>' after the lane type");
+
+    return typeTable.getVector(element, lanes);
+}
+
+NodeId Parser::parseFunction() {
 
     // Expected syntax
-    // func <name> () -> <type> { <body> }
+    // [export] func <name> (<name>: <type>, ...) -> <type> { <body> }
+    bool exported = match({TOKEN_EXPORT});
     consume(TOKEN_FUNC, "Expected 'func' at beginning of function definition");
     
     // Function name
-    std::string functionName;
-    Token funcNameToken;
+    std::string_view functionName;
+    uint32_t nameOffset = 0;
 
     if (match({TOKEN_START, TOKEN_IDENT})) {
-        funcNameToken = previous();
-        functionName = funcNameToken.lexeme;
+        functionName = previous().lexeme;
+        nameOffset = previous().offset;
     } else {
         throw std::runtime_error("Expected function name after 'func'");
     }
 
-    LOG_INFO("Parsing Function '" + functionName + "'");
-    LOG_SCOPE("Parsing");
+    LOG_INFO("Parsing Function '" + std::string(functionName) + "'");
+    LOG_SCOPE_DETAIL("Parsing", functionName);
 
-    // Parameter list (empty for now)
+    // Parameter list; the Param nodes lead the body list
     consume(TOKEN_LPAREN, "Expected '(' after function name");
-    consume(TOKEN_RPAREN, "Expected ')' after '(' in function definition");
+
+    std::vector<NodeId> bodyStatements;
+    if (!check(TOKEN_RPAREN)) {
+        do {
+            const Token& paramToken = consume(TOKEN_IDENT, "Expected parameter name");
+            AstNode paramNode(NodeKind::Param, paramToken.offset);
+            paramNode.name = paramToken.lexeme;
+
+            consume(TOKEN_COLON, "Expected ':' after parameter name");
+            paramNode.type = parseType();
+            bodyStatements.push_back(ast.add(paramNode));
+        } while (match({TOKEN_COMMA}));
+    }
+    consume(TOKEN_RPAREN, "Expected ')' after parameter list");
 
     // Return type
     consume(TOKEN_ARROW, "Expected '->' after parameter list");
-    std::string returnType = parseType();
+    TypeId returnType = parseType();
 
     // Function body
     consume(TOKEN_LBRACE, "Expected '{' to start function body");
 
     // We allow multiple statements in a function body
-    std::vector<std::unique_ptr<ASTNode>> bodyStatements;
-
     while (!check(TOKEN_RBRACE) && !isAtEOF()) {
 
         // Parse statement function processes print and const statements
@@ -126,23 +311,25 @@ std::unique_ptr<FuncNode> Parser::parseFunction() {
     
     consume(TOKEN_RBRACE, "Expected '}' to close function body");
 
-    auto funcNode = std::make_unique<FuncNode>();
-    funcNode->token = funcNameToken;
-    funcNode->name = functionName;
-    funcNode->returnType = returnType;
-    funcNode->body = std::move(bodyStatements);
+    AstNode funcNode(NodeKind::Function, nameOffset);
+    funcNode.name = functionName;
+    funcNode.type = returnType;
+    funcNode.op = exported ? 1 : 0;
 
-    return funcNode;
+    NodeId id = ast.add(funcNode);
+    ast.setBody(id, bodyStatements);
+    ast.addFunction(id);
+    return id;
 }
 
-std::unique_ptr<ASTNode> Parser::parseStatement() {
+NodeId Parser::parseStatement() {
     LOG_SCOPE("Parsing Statement");
 
     if (match({TOKEN_PRINT})) {
-        Token printToken = previous();
+        uint32_t printOffset = previous().offset;
         consume(TOKEN_LPAREN, "Expected '(' after 'print'");
 
-        std::string printText;
+        std::string_view printText;
         if (match({TOKEN_STRING})) {
             printText = previous().lexeme;
         } else {
@@ -151,136 +338,315 @@ std::unique_ptr<ASTNode> Parser::parseStatement() {
 
         consume(TOKEN_RPAREN, "Expected ')' after string literal");
 
-        auto printNode = std::make_unique<PrintNode>();
-        printNode->token = printToken;
-        printNode->text = printText;
-        return printNode;
+        AstNode printNode(NodeKind::Print, printOffset);
+        printNode.name = printText;
+        return ast.add(printNode);
     }
-    else if (match({TOKEN_CONST})) {
-        Token constToken = previous();
+    else if (match({TOKEN_CONST, TOKEN_VAR})) {
+        const Token& keyword = previous();
+        NodeKind kind = keyword.type == TOKEN_CONST ? NodeKind::Const : NodeKind::Var;
+        uint32_t declOffset = keyword.offset;
 
-        Token identToken = consume(TOKEN_IDENT, "Expected identifier after 'const'");
-        std::string name = identToken.lexeme;
+        std::string_view name = consume(TOKEN_IDENT, kind == NodeKind::Const ? "Expected identifier after 'const'"
+                                                                              : "Expected identifier after 'var'").lexeme;
 
         consume(TOKEN_COLON, "Expected ':' after identifier");
 
-        std::string declaredType = parseType();
-
-        consume(TOKEN_ASSIGN, "Expected '=' after type");
+        TypeId declaredType = parseType();
 
-        auto expr = parseExpression();
+        // A var without value is a zero-filled array (Sema rejects it for other types)
+        NodeId expr = kNoNode;
+        if (kind == NodeKind::Const || check(TOKEN_ASSIGN)) {
+            consume(TOKEN_ASSIGN, "Expected '=' after type");
+            expr = parseExpression();
+        }
 
-        auto node = std::make_unique<ConstNode>();
-        node->token = constToken;
-        node->name = name;
-        node->type = declaredType;
-        node->value = std::move(expr);
-        return node;
+        AstNode node(kind, declOffset);
+        node.name = name;
+        node.type = declaredType;
+        node.left() = expr;
+        return ast.add(node);
+    }
+    else if (match({TOKEN_WHILE})) {
+        // while <condition> { <body> }
+        AstNode loopNode(NodeKind::While, previous().offset);
+        std::vector<NodeId> entries { parseCondition() };
+        parseBlock(entries);
+
+        NodeId id = ast.add(loopNode);
+        ast.setLoop(id, entries);
+        return id;
+    }
+    else if (match({TOKEN_FOR})) {
+        // for <name> in <start>..<end> { <body> }
+        AstNode loopNode(NodeKind::For, previous().offset);
+        loopNode.name = consume(TOKEN_IDENT, "Expected loop variable after 'for'").lexeme;
+        consume(TOKEN_IN, "Expected 'in' after loop variable");
+
+        std::vector<NodeId> entries { parseExpression() };
+        consume(TOKEN_DOTDOT, "Expected '..' between start and end of the range");
+        entries.push_back(parseExpression());
+        parseBlock(entries);
+
+        NodeId id = ast.add(loopNode);
+        ast.setLoop(id, entries);
+        return id;
     }
     else if (match({TOKEN_RETURN})) {
-        Token returnToken = previous();
+        uint32_t returnOffset = previous().offset;
         
-        std::unique_ptr<ASTNode> returnVal = nullptr;
+        NodeId returnVal = kNoNode;
 
         // Check lookahead for expression starters
-        if (check(TOKEN_NUMBER) || check(TOKEN_CHAR) || check(TOKEN_LPAREN) || check(TOKEN_IDENT)) {
+        if (check(TOKEN_NUMBER) || check(TOKEN_CHAR) || check(TOKEN_LPAREN) || check(TOKEN_IDENT) || check(TOKEN_LEN) ||
+            check(TOKEN_REDUCE) || check(TOKEN_LBRACKET) || check(TOKEN_MINUS)) {
             returnVal = parseExpression();
         }
 
-        auto returnNode = std::make_unique<ReturnNode>();
-        returnNode->token = returnToken;
-        returnNode->returnValue = std::move(returnVal);
-        return returnNode;
+        AstNode returnNode(NodeKind::Return, returnOffset);
+        returnNode.left() = returnVal;
+        return ast.add(returnNode);
+    }
+
+    // A call whose result is not used
+    if (check(TOKEN_IDENT) && peekAhead(1).type == TOKEN_LPAREN) {
+        advance();
+        return parseCall(previous());
+    }
+
+    if (check(TOKEN_IDENT) && peekAhead(1).type == TOKEN_ASSIGN) {
+        advance();
+        AstNode assignNode(NodeKind::Assign, previous().offset);
+        assignNode.name = previous().lexeme;
+        advance(); // skip '='
+        assignNode.left() = parseExpression();
+        return ast.add(assignNode);
+    }
+
+    if (check(TOKEN_IDENT) && peekAhead(1).type == TOKEN_LBRACKET) {
+        // <name>[<index>] = <value>
+        advance();
+        AstNode assignNode(NodeKind::IndexAssign, previous().offset);
+        assignNode.name = previous().lexeme;
+        advance(); // skip '['
+        assignNode.left() = parseExpression();
+        consume(TOKEN_RBRACKET, "Expected ']' after index");
+        consume(TOKEN_ASSIGN, "Expected '=' after indexed element");
+        assignNode.right() = parseExpression();
+        return ast.add(assignNode);
     }
 
     Token t = currentToken();
-    throw std::runtime_error("Expected statement (print, const, or return) but found '" + t.lexeme + "'");
+    throw std::runtime_error("Expected statement (print, const, var, while, for, return, an assignment or a call) but found '" + std::string(t.lexeme) + "'");
+}
+
+void Parser::parseBlock(std::vector<NodeId>& statements) {
+    consume(TOKEN_LBRACE, "Expected '{' to start loop body");
+    while (!check(TOKEN_RBRACE) && !isAtEOF()) {
+        statements.push_back(parseStatement());
+    }
+    consume(TOKEN_RBRACE, "Expected '}' to close loop body");
 }
 
-std::unique_ptr<ASTNode> Parser::parseExpression() {
+NodeId Parser::parseCondition() {
+    // Condition ::= Expression ("==" | "!=" | "<" | "<=" | ">" | ">=") Expression
+    NodeId left = parseExpression();
+
+    char op = 0;
+    switch (currentToken().type) {
+        case TOKEN_EQUAL:         op = compareOps::Equal; break;
+        case TOKEN_NOT_EQUAL:     op = compareOps::NotEqual; break;
+        case TOKEN_LESS:          op = compareOps::Less; break;
+        case TOKEN_LESS_EQUAL:    op = compareOps::LessEqual; break;
+        case TOKEN_GREATER:       op = compareOps::Greater; break;
+        case TOKEN_GREATER_EQUAL: op = compareOps::GreaterEqual; break;
+        default:
+            syntaxError("Expected comparison operator (==, !=, <, <=, >, >=) in condition");
+    }
+
+    AstNode compareNode(NodeKind::Compare, currentToken().offset);
+    compareNode.op = op;
+    advance();
+
+    compareNode.left() = left;
+    compareNode.right() = parseExpression();
+    return ast.add(compareNode);
+}
+
+NodeId Parser::parseCall(const Token& callee) {
+    // Call ::= Identifier "(" [ Expression { "," Expression } ] ")"
+    AstNode callNode(NodeKind::Call, callee.offset);
+    callNode.name = callee.lexeme;
+    consume(TOKEN_LPAREN, "Expected '(' after function name");
+
+    std::vector<NodeId> arguments;
+    if (!check(TOKEN_RPAREN)) {
+        do {
+            arguments.push_back(parseExpression());
+        } while (match({TOKEN_COMMA}));
+    }
+    consume(TOKEN_RPAREN, "Expected ')' after arguments");
+
+    NodeId id = ast.add(callNode);
+    ast.setArguments(id, arguments);
+    return id;
+}
+
+NodeId Parser::parseIndex(const Token& name) {
+    // Index ::= Identifier "[" Expression [ ".." Expression ] "]"
+    // (the name token leaves the window while the index is parsed)
+    AstNode node(NodeKind::Index, name.offset);
+    node.name = name.lexeme;
+    consume(TOKEN_LBRACKET, "Expected '[' after array name");
+    node.left() = parseExpression();
+    if (match({TOKEN_DOTDOT})) {
+        node.kind = NodeKind::Slice;
+        node.right() = parseExpression();
+    }
+    consume(TOKEN_RBRACKET, "Expected ']' after index");
+    return ast.add(node);
+}
+
+NodeId Parser::parseArrayLiteral() {
+    // ArrayLiteral ::= "[" Expression { "," Expression } "]"
+    AstNode literal(NodeKind::ArrayLiteral, currentToken().offset);
+    consume(TOKEN_LBRACKET, "Expected '[' to start an array literal");
+
+    std::vector<NodeId> elements;
+    do {
+        elements.push_back(parseExpression());
+    } while (match({TOKEN_COMMA}));
+    consume(TOKEN_RBRACKET, "Expected ']' after array elements");
+
+    NodeId id = ast.add(literal);
+    ast.setElements(id, elements);
+    return id;
+}
+
+NodeId Parser::parseExpression() {
     // Expression ::= Term { ("+" | "-") Term }
-    auto left = parseTerm();
+    NodeId left = parseTerm();
 
     while (match({TOKEN_PLUS, TOKEN_MINUS})) {
-        Token opToken = previous();
-        std::string op = opToken.lexeme;
-        auto right = parseTerm();
-        
-        auto binaryNode = std::make_unique<BinaryOpNode>();
-        binaryNode->token = opToken;
-        binaryNode->left = std::move(left);
-        binaryNode->right = std::move(right);
-        binaryNode->op = op;
-        left = std::move(binaryNode);
+        const Token& opToken = previous();
+        AstNode binaryNode(NodeKind::BinaryOp, opToken.offset);
+        binaryNode.op = opToken.lexeme[0];
+
+        NodeId right = parseTerm();
+        binaryNode.left() = left;
+        binaryNode.right() = right;
+        left = ast.add(binaryNode);
     }
 
     return left;
 }
 
-std::unique_ptr<ASTNode> Parser::parseTerm() {
+NodeId Parser::parseTerm() {
     // Term ::= Factor { ("*" | "/") Factor }
-    auto left = parseFactor();
+    NodeId left = parseFactor();
 
     while (match({TOKEN_STAR, TOKEN_SLASH})) {
-        Token opToken = previous();
-        std::string op = opToken.lexeme;
-        auto right = parseFactor();
-
-        auto binaryNode = std::make_unique<BinaryOpNode>();
-        binaryNode->token = opToken;
-        binaryNode->left = std::move(left);
-        binaryNode->right = std::move(right);
-        binaryNode->op = op;
-        left = std::move(binaryNode);
+        const Token& opToken = previous();
+        AstNode binaryNode(NodeKind::BinaryOp, opToken.offset);
+        binaryNode.op = opToken.lexeme[0];
+
+        NodeId right = parseFactor();
+        binaryNode.left() = left;
+        binaryNode.right() = right;
+        left = ast.add(binaryNode);
     }
 
     return left;
 }
 
-std::unique_ptr<ASTNode> Parser::parseFactor() {
-    // Factor ::= NumberLiteral | "(" Expression ")"
+NodeId Parser::parseFactor() {
+    // Factor ::= NumberLiteral | CharLiteral | Identifier | Call | Index | Length | Reduce | ArrayLiteral | "(" Expression ")"
     
     if (match({TOKEN_MINUS})) {
-        Token opToken = previous();
-        auto operand = parseFactor(); // Recursion for "- - 5" Support
-
-        if (auto num = dynamic_cast<NumberNode*>(operand.get())) {
-            num->value = -num->value;
-            num->token = opToken; // Update Token location to the minus sign
+        uint32_t minusOffset = previous().offset;
+        NodeId operand = parseFactor(); // Recursion for "- - 5" Support
+
+        AstNode& num = ast.get(operand);
+        if (num.kind == NodeKind::Number) {
+            // Literals span -2^63 .. 2^64-1; the bits of -2^63 and 2^63 are the same
+            if (num.op == 'u' && num.number != INT64_MIN)
+                throw std::runtime_error("Syntax Error\nLine " + std::to_string(sourceManager.getLocation(minusOffset).line) + ": Integer literal out of range: below the minimum of int64");
+            if (num.op == 'u' || num.number == INT64_MIN)
+                num.op = num.op == 'u' ? 0 : 'u';
+            else
+                num.number = -num.number;
+            num.offset = minusOffset; // Update location to the minus sign
             return operand;
         }
-        throw std::runtime_error("Syntax Error\nLine " + std::to_string(opToken.line) + ": Only integer literals can be negated currently.");
+        throw std::runtime_error("Syntax Error\nLine " + std::to_string(sourceManager.getLocation(minusOffset).line) + ": Only integer literals can be negated currently.");
     }
 
     if (match({TOKEN_NUMBER})) {
-        Token numToken = previous();
-        int64_t val = std::stoll(numToken.lexeme);
-        auto node = std::make_unique<NumberNode>();
-        node->token = numToken;
-        node->value = val;
-        return node;
+        const Token& numToken = previous();
+        uint64_t val = 0;
+        const char* first = numToken.lexeme.data();
+        const char* last = first + numToken.lexeme.size();
+        if (std::from_chars(first, last, val).ec != std::errc()) {
+            throw std::runtime_error("Syntax Error\nLine " + std::to_string(sourceManager.getLocation(numToken.offset).line) + ": Integer literal out of range: " + std::string(numToken.lexeme));
+        }
+
+        // The whole uint64 range is accepted; Sema gives the literal the type it is converted to
+        AstNode node(NodeKind::Number, numToken.offset);
+        node.number = static_cast<int64_t>(val);
+        if (val > static_cast<uint64_t>(INT64_MAX))
+            node.op = 'u';
+        return ast.add(node);
     }
     else if (match({TOKEN_CHAR})) {
-        Token charToken = previous();
-        char val = charToken.lexeme[0];
-        auto node = std::make_unique<CharNode>();
-        node->token = charToken;
-        node->value = val;
-        return node;
+        const Token& charToken = previous();
+        AstNode node(NodeKind::Char, charToken.offset);
+        node.number = charToken.lexeme[0];
+        return ast.add(node);
     }
     else if (match({TOKEN_IDENT})) {
-        Token varToken = previous();
-        std::string name = varToken.lexeme;
-        auto node = std::make_unique<VariableNode>();
-        node->token = varToken;
-        node->name = name;
-        return node;
+        const Token& varToken = previous();
+        if (check(TOKEN_LPAREN))
+            return parseCall(varToken);
+        if (check(TOKEN_LBRACKET))
+            return parseIndex(varToken);
+
+        AstNode node(NodeKind::Variable, varToken.offset);
+        node.name = varToken.lexeme;
+        return ast.add(node);
+    }
+    else if (match({TOKEN_LEN})) {
+        // Length ::= "len" "(" Identifier ")"
+        AstNode node(NodeKind::Length, previous().offset);
+        consume(TOKEN_LPAREN, "Expected '(' after 'len'");
+        node.name = consume(TOKEN_IDENT, "Expected the name of an array or slice in len()").lexeme;
+        consume(TOKEN_RPAREN, "Expected ')' after the name in len()");
+        return ast.add(node);
+    }
+    else if (match({TOKEN_REDUCE})) {
+        // Reduce ::= "reduce" "(" ("+" | "*" | "min" | "max") "," Expression ")"
+        AstNode node(NodeKind::Reduce, previous().offset);
+        consume(TOKEN_LPAREN, "Expected '(' after 'reduce'");
+        if (match({TOKEN_PLUS, TOKEN_STAR})) {
+            node.op = previous().lexeme[0];
+        } else if (check(TOKEN_IDENT) && (currentToken().lexeme == "min" || currentToken().lexeme == "max")) {
+            node.op = currentToken().lexeme == "min" ? '<' : '>';
+            advance();
+        } else {
+            syntaxError("Expected +, *, min or max as the operation of reduce()");
+        }
+        consume(TOKEN_COMMA, "Expected ',' after the operation of reduce()");
+        node.left() = parseExpression();
+        consume(TOKEN_RPAREN, "Expected ')' after the vector in reduce()");
+        return ast.add(node);
+    }
+    else if (check(TOKEN_LBRACKET)) {
+        return parseArrayLiteral();
     }
     else if (match({TOKEN_LPAREN})) {
-        auto expr = parseExpression();
+        NodeId expr = parseExpression();
         consume(TOKEN_RPAREN, "Expected ')' after expression");
         return expr;
     }
 
-    throw std::runtime_error("Unexpected token in expression: " + currentToken().lexeme);
-}
\ No newline at end of file
+    throw std::runtime_error("Unexpected token in expression: " + std::string(currentToken().lexeme));
+}
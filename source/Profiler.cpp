@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "../include/Logger.h"
+#include "../include/Profiler.h"
+
+namespace {
+
+/// @brief Taken during static initialization, i.e. before main() runs (see Profiler::restartClock())
+uint64_t processStartNs = Profiler::now();
+
+} // namespace
+
+ProfileSite::ProfileSite(const char* name, const char* file, int line)
+    : name(name), file(file), line(line), id(Profiler::getInstance().registerSite(this)) {
+}
+
+Profiler& Profiler::getInstance() {
+    static Profiler instance;
+    return instance;
+}
+
+uint64_t Profiler::now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+uint32_t Profiler::registerSite(const ProfileSite* site) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    sites.push_back(site);
+    return static_cast<uint32_t>(sites.size() - 1);
+}
+
+const ProfileSite& Profiler::getDynamicSite(const std::string& name) {
+    // A separate lock, since constructing the site takes registryMutex
+    std::lock_guard<std::mutex> lock(dynamicSiteMutex);
+    for (const auto& site : dynamicSites) {
+        if (name == site->name) return *site;
+    }
+
+    dynamicNames.push_back(std::make_unique<std::string>(name));
+    dynamicSites.push_back(std::make_unique<ProfileSite>(dynamicNames.back()->c_str(), "", 0));
+    return *dynamicSites.back();
+}
+
+Profiler::ThreadProfile& Profiler::threadProfile() {
+    // The profile is owned by the profiler so it survives the thread for the summary
+    thread_local ThreadProfile* profile = nullptr;
+    if (!profile) {
+        auto created = std::make_unique<ThreadProfile>();
+        created->nodes.push_back(Node { UINT32_MAX, UINT32_MAX });
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        threads.push_back(std::move(created));
+        profile = threads.back().get();
+    }
+    return *profile;
+}
+
+uint32_t Profiler::enter(const ProfileSite& site) {
+    ThreadProfile& profile = threadProfile();
+    uint32_t parent = profile.current;
+
+    // Children lists are short; a linear walk is cheaper than any map
+    uint32_t child = profile.nodes[parent].firstChild;
+    while (child != UINT32_MAX && profile.nodes[child].site != site.id) {
+        child = profile.nodes[child].nextSibling;
+    }
+
+    if (child == UINT32_MAX) {
+        child = static_cast<uint32_t>(profile.nodes.size());
+        Node node { site.id, parent };
+        node.nextSibling = profile.nodes[parent].firstChild;
+        profile.nodes.push_back(node);
+        profile.nodes[parent].firstChild = child;
+    }
+
+    profile.current = child;
+    return child;
+}
+
+void Profiler::leave(uint32_t nodeIndex, uint64_t startNs, std::string_view detail) {
+    uint64_t durationNs = now() - startNs;
+    ThreadProfile& profile = threadProfile();
+
+    Node& node = profile.nodes[nodeIndex];
+    node.count++;
+    node.totalNs += durationNs;
+    node.minNs = std::min(node.minNs, durationNs);
+    node.maxNs = std::max(node.maxNs, durationNs);
+    node.histogram[bucketOf(durationNs)]++;
+
+    profile.nodes[node.parent].childNs += durationNs;
+    profile.current = node.parent;
+
+    if (tracing.load(std::memory_order_relaxed) && durationNs >= traceGranularityNs)
+        profile.events.push_back({ node.site, startNs, durationNs, std::string(detail) });
+}
+
+void Profiler::restartClock() {
+    processStartNs = now();
+}
+
+void Profiler::enableTracing(uint64_t granularityNs) {
+    traceGranularityNs = granularityNs;
+    tracing = true;
+}
+
+void Profiler::setThreadName(const std::string& name) {
+    threadProfile().name = name;
+}
+
+int Profiler::bucketOf(uint64_t ns) {
+    // Values below 2^kSubBucketBits get exact buckets, above that the top
+    // kSubBucketBits bits after the leading one select the sub-bucket
+    if (ns < (1u << kSubBucketBits))
+        return static_cast<int>(ns);
+
+    int msb = 63 - __builtin_clzll(ns);
+    int shift = msb - kSubBucketBits;
+    int sub = static_cast<int>((ns >> shift) & ((1u << kSubBucketBits) - 1));
+    return ((shift + 1) << kSubBucketBits) + sub;
+}
+
+double Profiler::bucketValueNs(int bucket) {
+    if (bucket < (1 << kSubBucketBits))
+        return bucket;
+
+    int shift = (bucket >> kSubBucketBits) - 1;
+    int sub = bucket & ((1 << kSubBucketBits) - 1);
+    double lower = std::ldexp(static_cast<double>((1 << kSubBucketBits) + sub), shift);
+    double width = std::ldexp(1.0, shift);
+    return lower + width / 2;   // Middle of the bucket
+}
+
+struct Profiler::SummaryNode {
+    uint32_t site = UINT32_MAX;
+    uint64_t count = 0;
+    uint64_t totalNs = 0;
+    uint64_t childNs = 0;
+    uint64_t minNs = UINT64_MAX;
+    uint64_t maxNs = 0;
+    std::array<uint64_t, kBucketCount> histogram {};
+    std::vector<std::unique_ptr<SummaryNode>> children;     ///< In order of first appearance
+};
+
+std::string Profiler::formatSummary() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    double totalAppTimeMs = (now() - processStartNs) / 1e6;
+
+    // Merge the per-thread trees by call path
+    SummaryNode root;
+    uint64_t mainThreadRootNs = 0;
+
+    for (size_t t = 0; t < threads.size(); ++t) {
+        const ThreadProfile& profile = *threads[t];
+
+        // Children are linked newest first; collect and reverse to keep the order of first use
+        auto childrenOf = [&profile] (uint32_t index) {
+            std::vector<uint32_t> result;
+            for (uint32_t c = profile.nodes[index].firstChild; c != UINT32_MAX; c = profile.nodes[c].nextSibling)
+                result.push_back(c);
+            std::reverse(result.begin(), result.end());
+            return result;
+        };
+
+        std::vector<std::pair<uint32_t, SummaryNode*>> stack { {0, &root} };
+        while (!stack.empty()) {
+            auto [index, target] = stack.back();
+            stack.pop_back();
+
+            for (uint32_t childIndex : childrenOf(index)) {
+                const Node& node = profile.nodes[childIndex];
+
+                SummaryNode* merged = nullptr;
+                for (auto& existing : target->children) {
+                    if (existing->site == node.site) merged = existing.get();
+                }
+                if (!merged) {
+                    target->children.push_back(std::make_unique<SummaryNode>());
+                    merged = target->children.back().get();
+                    merged->site = node.site;
+                }
+
+                merged->count += node.count;
+                merged->totalNs += node.totalNs;
+                merged->childNs += node.childNs;
+                merged->minNs = std::min(merged->minNs, node.minNs);
+                merged->maxNs = std::max(merged->maxNs, node.maxNs);
+                for (int b = 0; b < kBucketCount; ++b)
+                    merged->histogram[b] += node.histogram[b];
+
+                if (t == 0 && index == 0)
+                    mainThreadRootNs += node.totalNs;
+
+                stack.push_back({childIndex, merged});
+            }
+        }
+    }
+
+    auto percentileMs = [] (const SummaryNode& node, double fraction) {
+        uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * node.count));
+        uint64_t seen = 0;
+        for (int b = 0; b < kBucketCount; ++b) {
+            seen += node.histogram[b];
+            if (seen >= rank && node.histogram[b] > 0) {
+                double value = std::clamp(bucketValueNs(b), static_cast<double>(node.minNs), static_cast<double>(node.maxNs));
+                return value / 1e6;
+            }
+        }
+        return node.maxNs / 1e6;
+    };
+
+    std::stringstream summary;
+    const std::string ruleWide(118, '=');
+    const std::string rule(118, '-');
+
+    summary << "\n" << ruleWide << "\n";
+    summary << std::string(47, ' ') << "PERFORMANCE SUMMARY\n";
+    summary << rule << "\n";
+    summary << " Total Application Time: " << std::fixed << std::setprecision(3) << totalAppTimeMs << " ms\n";
+    summary << rule << "\n";
+    summary << std::left << std::setw(40) << " Phase / Scope"
+            << std::right << std::setw(8) << "Count"
+            << std::setw(11) << "Incl (ms)"
+            << std::setw(11) << "Excl (ms)"
+            << std::setw(10) << "Min"
+            << std::setw(10) << "P50"
+            << std::setw(10) << "P99"
+            << std::setw(10) << "Max"
+            << std::setw(8) << "% App" << "\n";
+    summary << rule << "\n";
+
+    // Depth-first, children indented by two spaces per level
+    std::vector<std::pair<const SummaryNode*, int>> rows;
+    for (auto it = root.children.rbegin(); it != root.children.rend(); ++it)
+        rows.push_back({it->get(), 0});
+
+    while (!rows.empty()) {
+        auto [node, depth] = rows.back();
+        rows.pop_back();
+
+        double inclusiveMs = node->totalNs / 1e6;
+        double exclusiveMs = (node->totalNs - std::min(node->childNs, node->totalNs)) / 1e6;
+        double percent = totalAppTimeMs > 0 ? (inclusiveMs / totalAppTimeMs) * 100.0 : 0.0;
+
+        std::string label = std::string(depth * 2, ' ') + sites[node->site]->name;
+        if (label.size() > 39)
+            label = label.substr(0, 36) + "...";     // Long names (e.g. LLVM passes) keep the columns aligned
+        summary << std::left << std::setw(40) << label
+                << std::right << std::setw(8) << node->count
+                << std::setprecision(3)
+                << std::setw(11) << inclusiveMs
+                << std::setw(11) << exclusiveMs
+                << std::setw(10) << node->minNs / 1e6
+                << std::setw(10) << percentileMs(*node, 0.50)
+                << std::setw(10) << percentileMs(*node, 0.99)
+                << std::setw(10) << node->maxNs / 1e6
+                << std::setprecision(2) << std::setw(7) << percent << "%\n";
+
+        for (auto it = node->children.rbegin(); it != node->children.rend(); ++it)
+            rows.push_back({it->get(), depth + 1});
+    }
+
+    // Time of the main thread that is not covered by any scope
+    double overheadTime = std::max(0.0, totalAppTimeMs - mainThreadRootNs / 1e6);
+    double overheadPercent = totalAppTimeMs > 0 ? (overheadTime / totalAppTimeMs) * 100.0 : 0.0;
+    summary << std::left << std::setw(40) << "Other / Overhead"
+            << std::right << std::setw(8) << "-"
+            << std::setprecision(3) << std::setw(11) << overheadTime
+            << std::setw(51) << ""
+            << std::setprecision(2) << std::setw(7) << overheadPercent << "%\n";
+
+    summary << ruleWide << "\n";
+    return summary.str();
+}
+
+void Profiler::printSummary() {
+    Logger::getInstance().output(formatSummary());
+}
+
+namespace {
+
+void writeJsonString(std::ostream& out, std::string_view text) {
+    out << '"';
+    for (char c : text) {
+        switch (c) {
+            case '"':  out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out << escaped;
+                } else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+void Profiler::writeTrace(const std::string& path) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Cannot write time trace " + path);
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    // Trace Event Format: complete ("X") events with microsecond timestamps,
+    // plus metadata events that name the process and the thread lanes
+    out << "{\"traceEvents\":[\n";
+    out << "{\"ph\":\"M\",\"pid\":1,\"tid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"picc\"}}";
+    out << std::fixed << std::setprecision(3);
+
+    for (size_t t = 0; t < threads.size(); ++t) {
+        ThreadProfile& profile = *threads[t];
+
+        std::string threadName = !profile.name.empty() ? profile.name
+                               : t == 0 ? "main" : "thread " + std::to_string(t);
+        out << ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+        writeJsonString(out, threadName);
+        out << "}}";
+
+        // Spans are recorded when they end; viewers prefer them by start time
+        std::stable_sort(profile.events.begin(), profile.events.end(), [] (const TraceEvent& a, const TraceEvent& b) {
+            return a.startNs < b.startNs;
+        });
+
+        for (const TraceEvent& event : profile.events) {
+            out << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << t << ",\"name\":";
+            writeJsonString(out, sites[event.site]->name);
+            out << ",\"ts\":" << (event.startNs - processStartNs) / 1e3
+                << ",\"dur\":" << event.durationNs / 1e3;
+            if (!event.detail.empty()) {
+                out << ",\"args\":{\"detail\":";
+                writeJsonString(out, event.detail);
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    if (!out)
+        throw std::runtime_error("Cannot write time trace " + path);
+}
@@ -0,0 +1,653 @@
+#include <cstdint>
+#include <stdexcept>
+
+#include <llvm/ADT/StringExtras.h>
+
+#include "../include/Logger.h"
+#include "../include/ScopedLogger.h"
+#include "../include/Sema.h"
+
+using llvm::APInt;
+using llvm::APSInt;
+
+namespace {
+
+/// @brief The representation of a value in AstNode::number (sign- or zero-extended by its type)
+int64_t toNumber(const APSInt& value) {
+    return value.isSigned() ? value.getSExtValue() : static_cast<int64_t>(value.getZExtValue());
+}
+
+/// @brief Whether a value survives the conversion to an integer type of the given width and signedness
+bool fitsInto(const APSInt& value, const TypeInfo& info) {
+    APSInt converted = value.extOrTrunc(info.bits);
+    converted.setIsUnsigned(!info.isSigned);
+    return APSInt::isSameValue(value, converted);
+}
+
+} // namespace
+
+Sema::Sema(const SourceManager& sourceManager, Ast& ast, bool boundsChecks)
+    : sourceManager(sourceManager), ast(ast), typeTable(TypeTable::getInstance()), boundsChecks(boundsChecks) {
+}
+
+std::string Sema::formatError(const AstNode& node, const std::string& message) const {
+    return sourceManager.formatError(node.offset, message);
+}
+
+void Sema::analyze() {
+    ast.indexFunctions();
+    for (NodeId function : ast.getFunctions()) {
+        analyzeFunction(function);
+    }
+}
+
+void Sema::analyzeFunction(NodeId function) {
+    const AstNode& funcNode = ast.get(function);
+    LOG_SCOPE_DETAIL("Analyze Function", funcNode.name);
+
+    // Arrays live on the stack of their function, so they only cross calls as slices
+    if (typeTable.get(funcNode.type).isAggregate())
+        throw std::runtime_error(formatError(funcNode, "Function cannot return an array or slice"));
+
+    // main is the entry point of executables and --run: called without arguments, its value is the exit status
+    if (funcNode.name == "main") {
+        if (ast.parameters(funcNode).size() != 0)
+            throw std::runtime_error(formatError(funcNode, "main cannot have parameters"));
+        if (typeTable.get(funcNode.type).kind != TypeKind::Integer)
+            throw std::runtime_error(formatError(funcNode, "main must return an integer (the exit status), not " +
+                                                           typeTable.getName(funcNode.type)));
+    }
+
+    // Every function starts with its parameters in scope; their values are only known at run time
+    scope.clear();
+    for (NodeId param : ast.parameters(funcNode)) {
+        const AstNode& paramNode = ast.get(param);
+        const TypeInfo& info = typeTable.get(paramNode.type);
+        if (info.isVoid())
+            throw std::runtime_error(formatError(paramNode, "Parameter cannot have type void"));
+        if (info.kind == TypeKind::Array)
+            throw std::runtime_error(formatError(paramNode, "Arrays are passed as slices: use []" +
+                                                            typeTable.getName(info.element) + " for " + std::string(paramNode.name)));
+        if (!scope.emplace(paramNode.name, Binding { paramNode.type, std::nullopt, false, ++bindingCount, std::nullopt }).second)
+            throw std::runtime_error(formatError(paramNode, "Duplicate parameter: " + std::string(paramNode.name)));
+    }
+
+    analyzeStatements(ast.body(funcNode), funcNode.type);
+}
+
+void Sema::analyzeStatements(NodeRange statements, TypeId returnType) {
+    for (NodeId stmt : statements) {
+        AstNode& node = ast.get(stmt);
+        switch (node.kind) {
+            case NodeKind::Const:
+                analyzeConst(node);
+                break;
+            case NodeKind::Var:
+                analyzeVar(node);
+                break;
+            case NodeKind::Assign:
+                analyzeAssign(node);
+                break;
+            case NodeKind::IndexAssign:
+                analyzeIndexAssign(node);
+                break;
+            case NodeKind::While:
+                analyzeCondition(ast.condition(node));
+                analyzeBlock(ast.loopBody(node), returnType);
+                break;
+            case NodeKind::For:
+                analyzeFor(node, returnType);
+                break;
+            case NodeKind::Return:
+                analyzeReturn(node, returnType);
+                break;
+            case NodeKind::Call:
+                analyzeExpression(stmt);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void Sema::analyzeBlock(NodeRange statements, TypeId returnType) {
+    // Declarations in the block may shadow outer names; the outer scope is back afterwards
+    std::unordered_map<std::string_view, Binding> outer = scope;
+    analyzeStatements(statements, returnType);
+    scope = std::move(outer);
+}
+
+void Sema::analyzeConst(const AstNode& constNode) {
+    const TypeInfo& info = typeTable.get(constNode.type);
+    if (info.isVoid())
+        throw std::runtime_error(formatError(constNode, "Constant cannot have type void"));
+
+    if (info.isAggregate()) {
+        if (info.kind == TypeKind::Array)
+            analyzeArrayLiteral(constNode.value(), constNode.type);
+        else
+            analyzeSliceValue(constNode.value(), constNode.type);
+        scope[constNode.name] = { constNode.type, std::nullopt, false, ++bindingCount, std::nullopt };
+        return;
+    }
+
+    analyzeConvertedValue(constNode.value(), constNode.type);
+
+    // A constant initializer must fit into the declared type; its uses are folded (vectors stay values)
+    const AstNode& value = ast.get(constNode.value());
+    std::optional<int64_t> constant;
+    if (isConstant(value) && !info.isVector())
+        constant = toNumber(convertConstant(value, constNode.type));
+
+    // Registered after the initializer so a constant cannot refer to itself
+    scope[constNode.name] = { constNode.type, constant, false, ++bindingCount, std::nullopt };
+}
+
+void Sema::analyzeVar(const AstNode& varNode) {
+    const TypeInfo& info = typeTable.get(varNode.type);
+    if (info.isVoid())
+        throw std::runtime_error(formatError(varNode, "Variable cannot have type void"));
+
+    if (varNode.value() == kNoNode) {
+        if (info.kind != TypeKind::Array)
+            throw std::runtime_error(formatError(varNode, "Variable " + std::string(varNode.name) +
+                                                          " needs an initial value (only arrays start zero-filled)"));
+    } else if (info.kind == TypeKind::Array) {
+        analyzeArrayLiteral(varNode.value(), varNode.type);
+    } else if (info.kind == TypeKind::Slice) {
+        analyzeSliceValue(varNode.value(), varNode.type);
+    } else {
+        analyzeConvertedValue(varNode.value(), varNode.type);
+    }
+
+    // The value changes at run time, so uses are never folded
+    scope[varNode.name] = { varNode.type, std::nullopt, true, ++bindingCount, std::nullopt };
+}
+
+void Sema::analyzeAssign(AstNode& assignNode) {
+    auto it = scope.find(assignNode.name);
+    if (it == scope.end())
+        throw std::runtime_error(formatError(assignNode, "Unknown variable: " + std::string(assignNode.name)));
+    if (!it->second.isMutable)
+        throw std::runtime_error(formatError(assignNode, "Cannot assign to " + std::string(assignNode.name) +
+                                                         " (only var can be assigned)"));
+
+    assignNode.type = it->second.type;
+    const TypeInfo& info = typeTable.get(assignNode.type);
+    if (info.kind == TypeKind::Array)
+        throw std::runtime_error(formatError(assignNode, "Cannot assign to array " + std::string(assignNode.name) +
+                                                         " as a whole (assign its elements)"));
+    if (info.kind == TypeKind::Slice) {
+        analyzeSliceValue(assignNode.value(), assignNode.type);
+        return;
+    }
+
+    analyzeConvertedValue(assignNode.value(), assignNode.type);
+}
+
+void Sema::analyzeIndexAssign(AstNode& assignNode) {
+    const Binding& base = lookupAggregate(assignNode);
+
+    // The elements of a slice are those of a var array (or of another slice)
+    TypeKind kind = typeTable.get(base.type).kind;
+    if (kind == TypeKind::Array && !base.isMutable)
+        throw std::runtime_error(formatError(assignNode, "Cannot assign to an element of " + std::string(assignNode.name) +
+                                                         " (only var arrays can be changed)"));
+    if (kind == TypeKind::Vector && !base.isMutable)
+        throw std::runtime_error(formatError(assignNode, "Cannot assign to a lane of " + std::string(assignNode.name) +
+                                                         " (only var vectors can be changed)"));
+
+    analyzeIndex(assignNode, base);
+    analyzeConvertedValue(assignNode.right(), assignNode.type);
+}
+
+void Sema::analyzeFor(AstNode& forNode, TypeId returnType) {
+    NodeId start = ast.rangeStart(forNode);
+    NodeId end = ast.rangeEnd(forNode);
+    analyzeScalarValue(start);
+    analyzeScalarValue(end);
+
+    // The loop variable has the type a comparison of the bounds would have
+    forNode.type = commonType(ast.get(start), ast.get(end));
+    checkConstantFits(start, forNode.type);
+    checkConstantFits(end, forNode.type);
+
+    // Bounds that are known here let accesses by the loop variable go unchecked
+    LoopRange range;
+    const AstNode& startNode = ast.get(start);
+    const AstNode& endNode = ast.get(end);
+    if (isConstant(startNode)) {
+        APSInt value = convertConstant(startNode, forNode.type);
+        if (!value.isNegative() && value.getActiveBits() < 64)
+            range.first = value.getExtValue();
+    }
+    if (isConstant(endNode)) {
+        APSInt value = convertConstant(endNode, forNode.type);
+        if (value.isNegative())
+            range.end = 0;
+        else if (value.getActiveBits() < 64)
+            range.end = value.getExtValue();
+    } else if (endNode.kind == NodeKind::Length) {
+        range.lengthOf = scope.at(endNode.name).id;
+    }
+
+    std::unordered_map<std::string_view, Binding> outer = scope;
+    scope[forNode.name] = { forNode.type, std::nullopt, false, ++bindingCount, range };
+    analyzeStatements(ast.loopBody(forNode), returnType);
+    scope = std::move(outer);
+}
+
+void Sema::analyzeCondition(NodeId id) {
+    AstNode& node = ast.get(id);
+    analyzeScalarValue(node.left());
+    analyzeScalarValue(node.right());
+
+    // Both sides are compared in a common type, like the operands of a binary operation
+    node.type = commonType(ast.get(node.left()), ast.get(node.right()));
+    checkConstantFits(node.left(), node.type);
+    checkConstantFits(node.right(), node.type);
+}
+
+void Sema::checkConstantFits(NodeId value, TypeId type) const {
+    const AstNode& node = ast.get(value);
+    if (isConstant(node))
+        (void)convertConstant(node, type);
+}
+
+void Sema::analyzeReturn(const AstNode& returnNode, TypeId returnType) {
+    bool isVoid = typeTable.get(returnType).isVoid();
+
+    if (returnNode.value() == kNoNode) {
+        if (!isVoid)
+            throw std::runtime_error(formatError(returnNode, "Function must return a value"));
+        return;
+    }
+
+    if (isVoid)
+        throw std::runtime_error(formatError(returnNode, "Void function cannot return a value"));
+
+    analyzeConvertedValue(returnNode.value(), returnType);
+}
+
+TypeId Sema::analyzeExpression(NodeId id, TypeId expected) {
+    AstNode& node = ast.get(id);
+
+    switch (node.kind) {
+        case NodeKind::Number:
+            node.type = literalType(node, expected);
+            break;
+
+        case NodeKind::Char:
+            node.type = types::Char8;
+            break;
+
+        case NodeKind::Variable: {
+            auto it = scope.find(node.name);
+            if (it == scope.end())
+                throw std::runtime_error(formatError(node, "Unknown variable: " + std::string(node.name)));
+            node.type = it->second.type;
+
+            // A use of a constant is its value (arrays and slices are checked where they are used)
+            if (it->second.value) {
+                node.kind = NodeKind::Constant;
+                node.number = *it->second.value;
+            }
+            break;
+        }
+
+        case NodeKind::BinaryOp: {
+            analyzeValue(node.left(), expected);
+            analyzeValue(node.right(), expected);
+
+            const AstNode& left = ast.get(node.left());
+            const AstNode& right = ast.get(node.right());
+            const TypeInfo& leftInfo = typeTable.get(left.type);
+            const TypeInfo& rightInfo = typeTable.get(right.type);
+
+            // Vectors are computed lane by lane; a scalar operand is splat to all lanes
+            TypeId scalarType;
+            if (leftInfo.isVector() || rightInfo.isVector()) {
+                if (leftInfo.isVector() && rightInfo.isVector() && left.type != right.type)
+                    throw std::runtime_error(formatError(node, "Operands have different vector types: " + leftInfo.name +
+                                                               " and " + rightInfo.name));
+                node.type = leftInfo.isVector() ? left.type : right.type;
+                scalarType = typeTable.get(node.type).element;
+            } else {
+                node.type = commonType(left, right);
+                scalarType = node.type;
+            }
+
+            // Constant operands are converted to the type of the operation (of its lanes) like at run time,
+            // so a literal that does not fit into it is an error
+            if (isConstant(left))
+                (void)convertConstant(left, scalarType);
+            if (isConstant(right)) {
+                if (node.op == '/' && constantValue(right).isZero())
+                    throw std::runtime_error(formatError(node, "Division by zero"));
+                (void)convertConstant(right, scalarType);
+            }
+
+            if (isConstant(left) && isConstant(right))
+                foldBinaryOp(node);
+            break;
+        }
+
+        case NodeKind::Call:
+            analyzeCall(node);
+            break;
+
+        case NodeKind::Index:
+            analyzeIndex(node, lookupAggregate(node));
+            break;
+
+        case NodeKind::Slice:
+            analyzeSlice(node);
+            break;
+
+        case NodeKind::Length: {
+            const Binding& base = lookupAggregate(node);
+            const TypeInfo& info = typeTable.get(base.type);
+            node.type = types::Int64;
+
+            // The length of an array or vector is part of its type
+            if (info.kind != TypeKind::Slice) {
+                if (info.length > static_cast<uint64_t>(INT64_MAX))
+                    throw std::runtime_error(formatError(node, "Array length does not fit into int64"));
+                node.kind = NodeKind::Constant;
+                node.number = static_cast<int64_t>(info.length);
+            }
+            break;
+        }
+
+        case NodeKind::Reduce: {
+            const TypeInfo& info = typeTable.get(analyzeValue(node.left()));
+            if (!info.isVector())
+                throw std::runtime_error(formatError(node, "A reduction needs a vector, not " + info.name));
+            node.type = info.element;
+            break;
+        }
+
+        case NodeKind::ArrayLiteral:
+            throw std::runtime_error(formatError(node, "An array literal can only initialize an array or a vector"));
+
+        default:
+            throw std::runtime_error(formatError(node, "Unknown expression node type"));
+    }
+
+    return node.type;
+}
+
+TypeId Sema::analyzeValue(NodeId id, TypeId expected) {
+    TypeId type = analyzeExpression(id, expected);
+    const AstNode& node = ast.get(id);
+    const TypeInfo& info = typeTable.get(type);
+    if (info.isVoid())
+        throw std::runtime_error(formatError(node, "Void function " + std::string(node.name) + " does not return a value"));
+    if (info.isAggregate())
+        throw std::runtime_error(formatError(node, "Cannot use " + info.name + " " + std::string(node.name) +
+                                                   " as a value (use its elements, a slice of it or len())"));
+    return type;
+}
+
+TypeId Sema::analyzeScalarValue(NodeId id) {
+    TypeId type = analyzeValue(id);
+    if (typeTable.get(type).isVector())
+        throw std::runtime_error(formatError(ast.get(id), "Expected a scalar, got " + typeTable.getName(type) +
+                                                          " (use one of its lanes or a reduction)"));
+    return type;
+}
+
+void Sema::analyzeConvertedValue(NodeId id, TypeId type) {
+    const TypeInfo& target = typeTable.get(type);
+
+    // The lanes of a vector can be listed like the elements of an array
+    if (target.isVector() && ast.get(id).kind == NodeKind::ArrayLiteral) {
+        analyzeArrayLiteral(id, type);
+        return;
+    }
+
+    TypeId valueType = analyzeValue(id, target.isVector() ? target.element : type);
+    const TypeInfo& info = typeTable.get(valueType);
+    if (info.isVector() && valueType != type)
+        throw std::runtime_error(formatError(ast.get(id), "Expected " + target.name + ", got " + info.name));
+
+    // A scalar converted to a vector is splat to all lanes
+    if (!info.isVector())
+        checkConstantFits(id, target.isVector() ? target.element : type);
+}
+
+void Sema::analyzeCall(AstNode& call) {
+    std::optional<NodeId> callee = ast.findFunction(call.name);
+    if (!callee)
+        throw std::runtime_error(formatError(call, "Unknown function: " + std::string(call.name)));
+    if (*callee == kNoNode)
+        throw std::runtime_error(formatError(call, "Function " + std::string(call.name) + " is defined more than once"));
+
+    const AstNode& function = ast.get(*callee);
+    NodeRange parameters = ast.parameters(function);
+    NodeRange arguments = ast.arguments(call);
+    if (arguments.size() != parameters.size())
+        throw std::runtime_error(formatError(call, "Function " + std::string(call.name) + " expects " +
+                                             std::to_string(parameters.size()) + " arguments, got " +
+                                             std::to_string(arguments.size())));
+
+    // Arguments are converted to the parameter types like constant initializers
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        TypeId paramType = ast.get(parameters.begin()[i]).type;
+        if (typeTable.get(paramType).kind == TypeKind::Slice) {
+            analyzeSliceValue(arguments.begin()[i], paramType);
+            continue;
+        }
+        analyzeConvertedValue(arguments.begin()[i], paramType);
+    }
+
+    call.type = function.type;
+}
+
+const Sema::Binding& Sema::lookupAggregate(const AstNode& node) const {
+    auto it = scope.find(node.name);
+    if (it == scope.end())
+        throw std::runtime_error(formatError(node, "Unknown variable: " + std::string(node.name)));
+    const TypeInfo& info = typeTable.get(it->second.type);
+    if (!info.isAggregate() && !info.isVector())
+        throw std::runtime_error(formatError(node, std::string(node.name) + " is not an array, slice or vector"));
+    return it->second;
+}
+
+void Sema::analyzeIndex(AstNode& access, const Binding& base) {
+    analyzeIndexValue(access.left());
+    access.type = typeTable.get(base.type).element;
+    access.op = decideBoundsCheck(access, base);
+}
+
+void Sema::analyzeIndexValue(NodeId id) {
+    TypeId type = analyzeValue(id);
+    if (typeTable.get(type).kind != TypeKind::Integer)
+        throw std::runtime_error(formatError(ast.get(id), "Index must be an integer, not " + typeTable.getName(type)));
+}
+
+void Sema::analyzeSlice(AstNode& slice) {
+    const Binding& base = lookupAggregate(slice);
+    const TypeInfo& info = typeTable.get(base.type);
+    if (info.isVector())
+        throw std::runtime_error(formatError(slice, "Cannot take a slice of vector " + std::string(slice.name) +
+                                                    " (its lanes are not in memory)"));
+    if (info.kind == TypeKind::Array && !base.isMutable)
+        throw std::runtime_error(formatError(slice, "Cannot take a slice of constant " + std::string(slice.name) +
+                                                    " (declare it with var)"));
+
+    analyzeIndexValue(slice.left());
+    analyzeIndexValue(slice.right());
+    slice.type = typeTable.getSlice(info.element);
+
+    // Constant bounds within an array are checked here
+    const AstNode& first = ast.get(slice.left());
+    const AstNode& end = ast.get(slice.right());
+    slice.op = boundsChecks::Checked;
+    if (!boundsChecks) {
+        slice.op = boundsChecks::Elided;
+    } else if (info.kind == TypeKind::Array && isConstant(first) && isConstant(end)) {
+        APSInt firstValue = constantValue(first);
+        APSInt endValue = constantValue(end);
+        APSInt length(APInt(64, info.length), true);
+        if (firstValue.isNegative() || endValue.isNegative() ||
+            APSInt::compareValues(firstValue, endValue) > 0 || APSInt::compareValues(endValue, length) > 0)
+            throw std::runtime_error(formatError(slice, "Slice " + toString(firstValue, 10) + ".." + toString(endValue, 10) +
+                                                        " out of bounds for " + info.name));
+        slice.op = boundsChecks::Elided;
+    }
+}
+
+void Sema::analyzeSliceValue(NodeId id, TypeId sliceType) {
+    AstNode& node = ast.get(id);
+    TypeId type = analyzeExpression(id);
+    const TypeInfo& info = typeTable.get(type);
+    const TypeInfo& expected = typeTable.get(sliceType);
+    if (!info.isAggregate() || info.element != expected.element)
+        throw std::runtime_error(formatError(node, "Expected " + expected.name + ", got " + info.name));
+
+    // Arrays only appear as names: the Variable becomes a slice of the whole array
+    if (info.kind == TypeKind::Array) {
+        if (!scope.at(node.name).isMutable)
+            throw std::runtime_error(formatError(node, "Cannot take a slice of constant " + std::string(node.name) +
+                                                       " (declare it with var)"));
+        node.type = sliceType;
+    }
+}
+
+void Sema::analyzeArrayLiteral(NodeId id, TypeId arrayType) {
+    AstNode& literal = ast.get(id);
+    const TypeInfo& info = typeTable.get(arrayType);
+    if (literal.kind != NodeKind::ArrayLiteral)
+        throw std::runtime_error(formatError(literal, "An array of type " + info.name + " must be initialized with an array literal"));
+
+    NodeRange elements = ast.elements(literal);
+    if (elements.size() != info.length)
+        throw std::runtime_error(formatError(literal, "Array literal has " + std::to_string(elements.size()) +
+                                                      " elements, " + info.name + " needs " + std::to_string(info.length)));
+
+    for (NodeId element : elements) {
+        analyzeConvertedValue(element, info.element);
+    }
+    literal.type = arrayType;
+}
+
+char Sema::decideBoundsCheck(const AstNode& access, const Binding& base) const {
+    if (!boundsChecks)
+        return boundsChecks::Elided;
+
+    // Arrays and vectors have their length in the type, slices only at run time
+    const TypeInfo& info = typeTable.get(base.type);
+    bool isArray = info.kind != TypeKind::Slice;
+    const AstNode& index = ast.get(access.left());
+
+    // A constant index into an array or vector is checked now
+    if (isConstant(index)) {
+        if (!isArray)
+            return boundsChecks::Checked;
+        APSInt value = constantValue(index);
+        if (value.isNegative() || value.getActiveBits() > 64 || value.getZExtValue() >= info.length)
+            throw std::runtime_error(formatError(index, "Index " + toString(value, 10) + " out of bounds for " + info.name));
+        return boundsChecks::Elided;
+    }
+
+    if (index.kind != NodeKind::Variable)
+        return boundsChecks::Checked;
+    const Binding& variable = scope.at(index.name);
+    if (!variable.loop)
+        return boundsChecks::Checked;
+
+    // The length must not change while the loop runs: arrays and vectors never change it, slices only if they are var
+    bool fixedLength = isArray || !base.isMutable;
+    const LoopRange& range = *variable.loop;
+    if (range.first && fixedLength) {
+        if (isArray && range.end && (*range.end <= *range.first || static_cast<uint64_t>(*range.end) <= info.length))
+            return boundsChecks::Elided;
+        if (range.lengthOf == base.id)
+            return boundsChecks::Elided;
+    }
+
+    // Otherwise a single check of the whole range before the loop (the base must exist there)
+    if (fixedLength && base.id < variable.id)
+        return boundsChecks::Hoisted;
+    return boundsChecks::Checked;
+}
+
+TypeId Sema::literalType(const AstNode& literal, TypeId expected) const {
+    APSInt value(APInt(64, static_cast<uint64_t>(literal.number)), literal.op == 'u');
+    if (expected != kNoType) {
+        const TypeInfo& info = typeTable.get(expected);
+        if (info.kind == TypeKind::Integer && fitsInto(value, info))
+            return expected;
+    }
+    return literal.op == 'u' ? types::Uint64 : types::Int64;
+}
+
+TypeId Sema::commonType(const AstNode& left, const AstNode& right) const {
+    bool leftLiteral = left.kind == NodeKind::Number;
+    bool rightLiteral = right.kind == NodeKind::Number;
+
+    if (leftLiteral && !rightLiteral) return right.type;
+    if (rightLiteral && !leftLiteral) return left.type;
+    if (left.type == right.type) return left.type;
+
+    const TypeInfo& a = typeTable.get(left.type);
+    const TypeInfo& b = typeTable.get(right.type);
+    if (a.bits != b.bits) return a.bits > b.bits ? left.type : right.type;
+    if (a.isSigned != b.isSigned) return a.isSigned ? right.type : left.type;
+    return left.type;
+}
+
+bool Sema::isConstant(const AstNode& node) {
+    return node.kind == NodeKind::Number || node.kind == NodeKind::Char || node.kind == NodeKind::Constant;
+}
+
+APSInt Sema::constantValue(const AstNode& node) const {
+    const TypeInfo& info = typeTable.get(node.type);
+    return APSInt(APInt(info.bits, static_cast<uint64_t>(node.number), info.isSigned), !info.isSigned);
+}
+
+APSInt Sema::convertConstant(const AstNode& node, TypeId type) const {
+    const TypeInfo& info = typeTable.get(type);
+    APSInt value = constantValue(node);
+
+    // Extended by the signedness of the source, like convert() in the generated code
+    if (!fitsInto(value, info))
+        throw std::runtime_error(formatError(node, "Constant value out of range (" + info.name + ")"));
+
+    APSInt converted = value.extOrTrunc(info.bits);
+    converted.setIsUnsigned(!info.isSigned);
+    return converted;
+}
+
+void Sema::foldBinaryOp(AstNode& node) {
+    const TypeInfo& info = typeTable.get(node.type);
+    APSInt left = convertConstant(ast.get(node.left()), node.type);
+    APSInt right = convertConstant(ast.get(node.right()), node.type);
+
+    // Evaluated in the width and signedness of the operation; overflow is what would wrap at run time
+    bool overflow = false;
+    APInt result;
+    switch (node.op) {
+        case '+':
+            result = info.isSigned ? left.sadd_ov(right, overflow) : left.uadd_ov(right, overflow);
+            break;
+        case '-':
+            result = info.isSigned ? left.ssub_ov(right, overflow) : left.usub_ov(right, overflow);
+            break;
+        case '*':
+            result = info.isSigned ? left.smul_ov(right, overflow) : left.umul_ov(right, overflow);
+            break;
+        case '/':
+            result = info.isSigned ? left.sdiv_ov(right, overflow) : left.udiv(right);
+            break;
+        default:
+            throw std::runtime_error(formatError(node, "Unknown binary operator: " + std::string(1, node.op)));
+    }
+
+    if (overflow)
+        throw std::runtime_error(formatError(node, "Constant expression overflows " + info.name));
+
+    node.kind = NodeKind::Constant;
+    node.number = toNumber(APSInt(result, !info.isSigned));
+}
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/LexerScan.h"
+#include "../include/Logger.h"
+#include "../include/SourceManager.h"
+
+SourceManager::SourceManager(std::string fileName, std::string source)
+    : fileName(std::move(fileName)), ownedBuffer(std::move(source)) {
+    buffer = ownedBuffer;
+}
+
+SourceManager::SourceManager(std::string fileName) : fileName(std::move(fileName)) {
+}
+
+SourceManager::~SourceManager() {
+    if (mappedData) {
+        munmap(mappedData, mappedSize);
+    }
+}
+
+std::unique_ptr<SourceManager> SourceManager::loadFile(const std::string& path) {
+
+    // The constructor is private, so make_unique cannot be used here
+    std::unique_ptr<SourceManager> sourceManager(new SourceManager(path == "-" ? "<stdin>" : path));
+
+    if (path == "-") {
+        sourceManager->loadFromDescriptor(STDIN_FILENO);
+        return sourceManager;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open file " + path);
+
+    try {
+        sourceManager->loadFromDescriptor(fd);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    return sourceManager;
+}
+
+void SourceManager::loadFromDescriptor(int fd) {
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+        throw std::runtime_error("Cannot stat file " + fileName + ": " + std::strerror(errno));
+
+    // Regular files are mapped; an empty file cannot be mapped and simply stays empty
+    if (S_ISREG(info.st_mode)) {
+        if (info.st_size == 0) {
+            buffer = std::string_view();
+            return;
+        }
+
+        void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            mappedData = data;
+            mappedSize = static_cast<size_t>(info.st_size);
+            buffer = std::string_view(static_cast<const char*>(data), mappedSize);
+            LOG_DEBUG("Mapped " + std::to_string(mappedSize) + " bytes of " + fileName);
+            return;
+        }
+
+        LOG_WARNING("mmap failed for " + fileName + ", falling back to read()");
+    }
+
+    // Pipes, terminals, etc.: read into one buffer that grows geometrically
+    size_t length = 0;
+    ownedBuffer.resize(64 * 1024);
+
+    while (true) {
+        if (length == ownedBuffer.size())
+            ownedBuffer.resize(ownedBuffer.size() * 2);
+
+        ssize_t bytesRead = read(fd, &ownedBuffer[length], ownedBuffer.size() - length);
+        if (bytesRead < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Cannot read file " + fileName + ": " + std::strerror(errno));
+        }
+        if (bytesRead == 0) break;
+        length += static_cast<size_t>(bytesRead);
+    }
+
+    ownedBuffer.resize(length);
+    buffer = ownedBuffer;
+}
+
+std::string_view SourceManager::getBuffer() const {
+    return buffer;
+}
+
+const std::string& SourceManager::getFileName() const {
+    return fileName;
+}
+
+SourceLocation SourceManager::getLocation(uint32_t offset) const {
+
+    std::call_once(lineStartsBuilt, [this] () {
+        const ScanKernels& kernels = getScanKernels();
+        lineStarts.reserve(kernels.count(buffer.data(), buffer.size(), 0, '\n') + 1);
+        lineStarts.push_back(0);
+
+        size_t pos = kernels.findEither(buffer.data(), buffer.size(), 0, '\n', '\n');
+        while (pos < buffer.size()) {
+            lineStarts.push_back(static_cast<uint32_t>(pos + 1));
+            pos = kernels.findEither(buffer.data(), buffer.size(), pos + 1, '\n', '\n');
+        }
+    });
+
+    // The last line start that is <= offset
+    auto it = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset);
+    size_t lineIndex = static_cast<size_t>(it - lineStarts.begin()) - 1;
+
+    return {static_cast<int>(lineIndex + 1), static_cast<int>(offset - lineStarts[lineIndex] + 1)};
+}
+
+std::string SourceManager::formatError(uint32_t offset, const std::string& message) const {
+    SourceLocation location = getLocation(offset);
+    return "Error: [" + fileName + ", Line " + std::to_string(location.line) +
+           ", Col " + std::to_string(location.column) + "] " + message;
+}
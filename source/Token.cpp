@@ -5,6 +5,7 @@ std::string TokenTypeToString(TokenType tokenType) {
     switch (tokenType) {
 
         case TokenType::TOKEN_FUNC:     return "func";
+        case TokenType::TOKEN_EXPORT:   return "export";
         case TokenType::TOKEN_RETURN:   return "return";
         case TokenType::TOKEN_VOID:     return "void";
 
@@ -12,6 +13,12 @@ std::string TokenTypeToString(TokenType tokenType) {
         case TokenType::TOKEN_IDENT:    return "identifier";
         case TokenType::TOKEN_PRINT:    return "print";
         case TokenType::TOKEN_CONST:    return "const";
+        case TokenType::TOKEN_VAR:      return "var";
+        case TokenType::TOKEN_WHILE:    return "while";
+        case TokenType::TOKEN_FOR:      return "for";
+        case TokenType::TOKEN_IN:       return "in";
+        case TokenType::TOKEN_LEN:      return "len";
+        case TokenType::TOKEN_REDUCE:   return "reduce";
 
         case TokenType::TOKEN_LPAREN:   return "(";
         case TokenType::TOKEN_RPAREN:   return ")";
@@ -19,14 +26,26 @@ std::string TokenTypeToString(TokenType tokenType) {
         case TokenType::TOKEN_LBRACE:   return "{";
         case TokenType::TOKEN_RBRACE:   return "}";
 
+        case TokenType::TOKEN_LBRACKET: return "[";
+        case TokenType::TOKEN_RBRACKET: return "]";
+
         case TokenType::TOKEN_COLON:    return ":";
+        case TokenType::TOKEN_COMMA:    return ",";
         case TokenType::TOKEN_ASSIGN:   return "=";
         case TokenType::TOKEN_ARROW:    return "->";
+        case TokenType::TOKEN_DOTDOT:   return "..";
 
         case TokenType::TOKEN_PLUS:     return "+";
         case TokenType::TOKEN_MINUS:    return "-";
         case TokenType::TOKEN_STAR:     return "*";
         case TokenType::TOKEN_SLASH:    return "/";
+
+        case TokenType::TOKEN_EQUAL:            return "==";
+        case TokenType::TOKEN_NOT_EQUAL:        return "!=";
+        case TokenType::TOKEN_LESS:             return "<";
+        case TokenType::TOKEN_LESS_EQUAL:       return "<=";
+        case TokenType::TOKEN_GREATER:          return ">";
+        case TokenType::TOKEN_GREATER_EQUAL:    return ">=";
         
         // CHARACTER TYPES
 
@@ -57,4 +76,5 @@ std::string TokenTypeToString(TokenType tokenType) {
         
     }
 
+    return "unknown";
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include "../include/TokenBuffer.h"
+
+Token TokenBuffer::get(size_t index) const {
+    TokenType type = kind(index);
+    uint32_t start = offsets[index];
+    std::string_view text = source.substr(start, lengths[index]);
+
+    switch (type) {
+        case TOKEN_STRING: {
+            // Strip the quotes; an unterminated string runs to the end of the file
+            bool closed = text.size() >= 2 && (text.back() == '"' || text.back() == '\0');
+            return {type, text.substr(1, text.size() - (closed ? 2 : 1)), start};
+        }
+        case TOKEN_CHAR:
+            // 'x' or '\x': the character sits right before the closing quote
+            return {type, text.substr(text.size() - 2, 1), start};
+        default:
+            return {type, text, start};
+    }
+}
+
+Token TokenBufferSource::next() {
+    if (index < end && buffer.kind(index) != TOKEN_EOF)
+        return buffer.get(index++);
+
+    // The end of the range acts as end of file
+    uint32_t offset = 0;
+    if (index < buffer.size())
+        offset = buffer.offset(index);
+    else if (buffer.size() > 0)
+        offset = buffer.offset(buffer.size() - 1);
+
+    return {TOKEN_EOF, "", offset};
+}
@@ -0,0 +1,69 @@
+#include <stdexcept>
+
+#include "../include/Types.h"
+
+TypeTable& TypeTable::getInstance() {
+    static TypeTable instance;
+    return instance;
+}
+
+TypeTable::TypeTable() {
+    // Same order as the ids in the types namespace
+    intern({ TypeKind::Void, 0, false, "void" });
+    intern({ TypeKind::Integer, 8, true, "int8" });
+    intern({ TypeKind::Integer, 16, true, "int16" });
+    intern({ TypeKind::Integer, 32, true, "int32" });
+    intern({ TypeKind::Integer, 64, true, "int64" });
+    intern({ TypeKind::Integer, 8, false, "uint8" });
+    intern({ TypeKind::Integer, 16, false, "uint16" });
+    intern({ TypeKind::Integer, 32, false, "uint32" });
+    intern({ TypeKind::Integer, 64, false, "uint64" });
+    intern({ TypeKind::Char, 8, true, "char8" });
+    intern({ TypeKind::Char, 16, true, "char16" });
+    intern({ TypeKind::Char, 32, true, "char32" });
+}
+
+TypeId TypeTable::intern(const TypeInfo& info) {
+    std::lock_guard<std::mutex> lock(internMutex);
+
+    size_t size = count.load(std::memory_order_relaxed);
+    for (size_t id = 0; id < size; ++id) {
+        const TypeInfo& existing = get(static_cast<TypeId>(id));
+        if (existing.kind == info.kind && existing.bits == info.bits &&
+            existing.isSigned == info.isSigned && existing.name == info.name &&
+            existing.element == info.element && existing.length == info.length)
+            return static_cast<TypeId>(id);
+    }
+
+    if (size >= kNoType)
+        throw std::runtime_error("Too many distinct types");
+
+    auto& chunk = chunks[size >> kChunkBits];
+    if (!chunk)
+        chunk = std::make_unique<TypeInfo[]>(kChunkSize);
+    chunk[size & (kChunkSize - 1)] = info;
+
+    count.store(size + 1, std::memory_order_release);
+    return static_cast<TypeId>(size);
+}
+
+TypeId TypeTable::getArray(TypeId element, uint64_t length) {
+    TypeInfo info { TypeKind::Array, 0, false, "[" + std::to_string(length) + "]" + get(element).name };
+    info.element = element;
+    info.length = length;
+    return intern(info);
+}
+
+TypeId TypeTable::getSlice(TypeId element) {
+    TypeInfo info { TypeKind::Slice, 0, false, "[]" + get(element).name };
+    info.element = element;
+    return intern(info);
+}
+
+TypeId TypeTable::getVector(TypeId element, uint64_t lanes) {
+    // Signed like its lanes, so operations pick the same instructions as for scalars
+    TypeInfo info { TypeKind::Vector, 0, get(element).isSigned, "vec" + std::to_string(lanes) + "<" + get(element).name + ">" };
+    info.element = element;
+    info.length = lanes;
+    return intern(info);
+}
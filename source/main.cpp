@@ -1,92 +1,574 @@
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "../include/Codegen.h"
+#include "../include/CompileCache.h"
+#include "../include/CompileServer.h"
+#include "../include/Emitter.h"
+#include "../include/Jit.h"
 #include "../include/Lexer.h"
 #include "../include/Logger.h"
+#include "../include/Optimizer.h"
 #include "../include/ScopedLogger.h"
 #include "../include/Parser.h"
+#include "../include/Profiler.h"
+#include "../include/Sema.h"
+#include "../include/SourceManager.h"
 
-/// @brief Helper function to read a file into a string
-/// @param filename The name of the file to read
-/// @return The content of the file as a string
-std::string readFile(const std::string &filename) {
-    std::ifstream file(filename);
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/StringSaver.h>
+#include <llvm/Support/ThreadPool.h>
 
-    if (!file)
-        throw std::runtime_error("Cannot open file " + filename);
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+/// @brief Functions per module in --run mode: the JIT's work per lazy compile grows with the module size
+constexpr size_t kFunctionsPerJitModule = 16;
+
+/**
+ * @brief Writes a finished compile output (e.g. a compile cache entry) to its destination.
+ *
+ * The output goes to the output file (stdout if there is none or it is "-"),
+ * an executable is linked from the object file.
+ */
+static void writeOutputFile(const std::string& file, OutputKind kind, const std::string& outputPath) {
+    if (kind == OutputKind::Executable) {
+        Emitter::linkExecutable(file, outputPath);
+        return;
+    }
+
+    if (outputPath.empty() || outputPath == "-") {
+        CompileCache::copyFile(file, STDOUT_FILENO);
+        return;
+    }
+
+    int fd = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + outputPath);
+    try {
+        CompileCache::copyFile(file, fd);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
 }
 
-// The Pi file is given by the arguments    
-int main(int argc, char **argv) {
+/// @brief Prints the performance summary and writes the time trace if requested
+static bool finishProfiling(const std::string& timeTracePath) {
+    Profiler::getInstance().printSummary();
 
-    // Logger configuration
+    if (!timeTracePath.empty()) {
+        try {
+            Profiler::getInstance().writeTrace(timeTracePath);
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Console and file logging of a compile (the log file is opened in the working directory)
+static void configureLogging() {
     Logger::getInstance().setLogLevel(LogLevel::DEBUG);
-    Logger::getInstance().enableFileLogging("pi_compiler.log");
+    Logger::getInstance().enableFileLogging("pi_compiler.log", LogLevel::DEBUG);
+    Logger::getInstance().setFileRotation(16 * 1024 * 1024, 3);
+    Logger::getInstance().enableAsyncLogging();
+}
 
-    LOG_INFO("PICC starting");
+/// @brief Options of one picc invocation, shared by all of its input files
+struct CompileOptions {
+    OptLevel optLevel = OptLevel::O0;
+    bool timePasses = false;
+    OutputKind outputKind = OutputKind::IR;
+    bool runProgram = false;
+    bool useCache = false;
+    bool incremental = false;
+    bool boundsChecks = true;   ///< false with --no-bounds-checks
+    std::string compiler;       ///< Compiler identity for cache keys (--cache and --incremental)
+};
 
-    if (argc < 2) {
-        LOG_ERROR("Insufficient command line arguments");
-        std::cerr << "Usage: " << argv[0] << " <pi_file_path>" << std::endl;
-        return 1;
-    }
-    
-    // Reads the path to the Pi file from the command line
-    std::string filePath = argv[1];
-    std::string source;
+/**
+ * @brief Compiles one file: the whole pipeline from reading the source to writing the output.
+ *
+ * @param options The options of the invocation.
+ * @param filePath The source file ("-" reads stdin).
+ * @param outputPath The output file; empty prints IR on stdout.
+ * @param jobs Threads for parsing and code generation of this file.
+ * @param errors Receives the diagnostics.
+ * @return The exit status (the program's with --run), or nothing if the compile failed.
+ */
+static std::optional<int> compileFile(const CompileOptions& options, const std::string& filePath,
+                                      const std::string& outputPath, unsigned jobs, std::ostream& errors) {
+    OptLevel optLevel = options.optLevel;
+    OutputKind outputKind = options.outputKind;
+    bool runProgram = options.runProgram;
+
+    // Reads the path to the Pi file from the command line ("-" reads stdin).
+    // The source manager maps the file; tokens and AST nodes only keep views into it
+    std::unique_ptr<SourceManager> sourceManager;
     try {
-        source = readFile(filePath);
+        sourceManager = SourceManager::loadFile(filePath);
     } catch (const std::runtime_error &e) {
-        std::cerr << "Error reading the file: " << e.what() << std::endl;
-        return 1;
+        Logger::getInstance().flush();
+        errors << "Error reading the file: " << e.what() << std::endl;
+        return std::nullopt;
     }
 
-    // Lexical analysis: Tokenize the read pi language code
-    Lexer lexer(source);
-    auto tokens = lexer.tokenize();
+    // Compile cache: a hit serves the stored output and skips the whole pipeline.
+    // Executables cache their object code, so they share entries with -c
+    std::unique_ptr<CompileCache> cache;
+    std::string cacheKey;
+    OutputKind cachedKind = outputKind == OutputKind::Executable ? OutputKind::Object : outputKind;
+    if (options.useCache && !runProgram) {
+        cache = std::make_unique<CompileCache>(CompileCache::defaultDirectory(), CompileCache::defaultMaxBytes());
+        std::string cacheOptions = "-O" + std::to_string(static_cast<int>(optLevel)) +
+                                   " output=" + std::to_string(static_cast<int>(cachedKind)) +
+                                   (options.boundsChecks ? "" : " --no-bounds-checks");
+        cacheKey = CompileCache::computeKey(options.compiler, cacheOptions, sourceManager->getBuffer());
 
-    // Parsing: Build an AST from the tokens
-    Parser parser(tokens);
-    std::vector<std::unique_ptr<FuncNode>> functions;
-    
+        std::string entry;
+        try {
+            LOG_SCOPE("Cache Lookup");
+            entry = cache->lookup(cacheKey);
+            if (!entry.empty())
+                writeOutputFile(entry, outputKind, outputPath);
+            cache->flush();
+        } catch (const std::runtime_error &e) {
+            Logger::getInstance().flush();
+            errors << "Cache error: " << e.what() << "\n";
+            return std::nullopt;
+        }
+
+        if (!entry.empty())
+            return 0;
+    }
+
+    // Lexical analysis and parsing: the parser pulls tokens from the lexer on demand,
+    // so the token stream is never materialized as a whole. With -j the functions
+    // are parsed on several threads; if that fails the serial parse reports the error
+    Ast ast;
     try {
-        while (!parser.isAtEOF()) {
-            functions.push_back(parser.parseFunction());
+        LOG_SCOPE("Lexing + Parsing");
+        if (jobs <= 1 || !Parser::parseInParallel(*sourceManager, ast, jobs)) {
+            ast = Ast();
+            Lexer lexer(*sourceManager);
+            Parser parser(lexer, *sourceManager, ast);
+            while (!parser.isAtEOF()) {
+                parser.parseFunction();
+            }
         }
     } catch (const std::runtime_error &e) {
-        std::cerr << "Parsing error: " << e.what() << "\n";
-        return 1;
+        // Pending log lines first, so the error is the last thing on stderr
+        Logger::getInstance().flush();
+        errors << "Parsing error: " << e.what() << "\n";
+        return std::nullopt;
+    }
+
+    // Semantic analysis: resolves and checks all types before any IR is built
+    try {
+        LOG_SCOPE("Semantic Analysis");
+        Sema sema(*sourceManager, ast, options.boundsChecks);
+        sema.analyze();
+    } catch (const std::runtime_error &e) {
+        Logger::getInstance().flush();
+        errors << e.what() << "\n";
+        return std::nullopt;
     }
 
     // Code generation via the outsourced module
-    Codegen codegen;
-    {
-        LOG_SCOPE("Code Generation");
-        for (const auto& func : functions) {
-            codegen.generateCode(func.get());
+    Codegen codegen(*sourceManager, ast);
+    Optimizer optimizer(optLevel, options.timePasses);
+    bool optimized = false;
+    std::string entryName;
+    std::vector<Codegen::GeneratedModule> jitModules;
+    const std::vector<NodeId>& functions = ast.getFunctions();
+    try {
+        // Incremental: every function is keyed by its tokens. The source parsed
+        // successfully, so tokenizing it again cannot fail. The store holds
+        // optimized functions; at O0 generating a function is cheaper than reading it
+        std::unique_ptr<CompileCache> functionStore;
+        std::vector<std::string> functionKeys;
+        if (options.incremental && !runProgram && optLevel != OptLevel::O0) {
+            LOG_SCOPE("Function Keys");
+            functionStore = std::make_unique<CompileCache>(CompileCache::functionStoreDirectory(), CompileCache::defaultMaxBytes());
+            Lexer lexer(*sourceManager);
+            TokenBuffer tokens = lexer.tokenize();
+            std::string keyOptions = "-O" + std::to_string(static_cast<int>(optLevel)) +
+                                     (options.boundsChecks ? "" : " --no-bounds-checks");
+            functionKeys = CompileCache::computeFunctionKeys(options.compiler, keyOptions, tokens, Parser::findFunctionBoundaries(tokens));
+        }
+
+        {
+            LOG_SCOPE("Code Generation");
+            if (runProgram)
+                jitModules = codegen.generateModules(functions, kFunctionsPerJitModule);
+            else if (functionStore)
+                optimized = codegen.generateIncremental(functions, functionKeys, *functionStore, optimizer);
+            else
+                codegen.generateFunctions(functions, jobs);
         }
+
+        if (functionStore) {
+            LOG_SCOPE("Function Store Update");
+            functionStore->flush();
+        }
+
+        // Create the main function that calls the entry: the program's main, which is also the
+        // entry of a linked executable, or else the last parsed function. An entry with
+        // parameters has nothing to be called with (e.g. the last function of a library)
+        std::optional<NodeId> entry = ast.findFunction("main");
+        if (!entry && !functions.empty() && ast.parameters(ast.get(functions.back())).size() == 0)
+            entry = functions.back();
+        if (entry) {
+            LOG_SCOPE("LLVM IR Construction (Main)");
+            entryName = codegen.createMainWrapper(*entry)->getName().str();
+        }
+    } catch (const std::runtime_error &e) {
+        Logger::getInstance().flush();
+        errors << "Code generation error: " << e.what() << "\n";
+        return std::nullopt;
+    }
+
+    // Optimization runs in-process on the linked module (--run optimizes each function when it
+    // is compiled, --incremental before it is stored)
+    try {
+        if (!runProgram && !optimized)
+            optimizer.run(*codegen.getModule());
+    } catch (const std::runtime_error &e) {
+        Logger::getInstance().flush();
+        errors << "Optimization error: " << e.what() << "\n";
+        return std::nullopt;
     }
 
-    // Create the main function that calls the generated function
-    // For now, we wrap the last parsed function as the entry point 
-    // This maintains behavior for single-function files while supporting multiple functions
-    if (!functions.empty()) {
-        LOG_SCOPE("LLVM IR Construction (Main)");
-        codegen.createMainWrapper(functions.back()->name);
+    // Output: run in-process (--run), textual IR on stdout or in a file, or native code through the host target
+    int exitStatus = 0;
+    if (runProgram) {
+        if (entryName.empty()) {
+            Logger::getInstance().flush();
+            errors << "Nothing to run: the program has no functions, or the last one takes parameters" << std::endl;
+            return std::nullopt;
+        }
+
+        try {
+            // The module with the wrapper goes last, after the functions it calls
+            jitModules.push_back({ codegen.takeContext(), std::move(codegen.getModule()) });
+
+            Jit jit(optLevel, options.timePasses);
+            exitStatus = jit.run(std::move(jitModules), entryName);
+        } catch (const std::runtime_error &e) {
+            Logger::getInstance().flush();
+            errors << "JIT error: " << e.what() << "\n";
+            return std::nullopt;
+        }
+    } else if (cache) {
+        // Produce the output in memory, store it and serve it from the new entry
+        try {
+            std::string entry;
+            if (cachedKind == OutputKind::IR) {
+                std::string ir;
+                llvm::raw_string_ostream out(ir);
+                codegen.printModule(out);
+                out.flush();
+                entry = cache->store(cacheKey, ir);
+            } else {
+                Emitter emitter(optLevel);
+                llvm::SmallVector<char, 0> code = emitter.emitToMemory(*codegen.getModule(), cachedKind);
+                entry = cache->store(cacheKey, std::string_view(code.data(), code.size()));
+            }
+            writeOutputFile(entry, outputKind, outputPath);
+
+            // Evicting afterwards, so even an entry above the size limit is served once
+            cache->flush();
+        } catch (const std::runtime_error &e) {
+            Logger::getInstance().flush();
+            errors << "Emission error: " << e.what() << "\n";
+            return std::nullopt;
+        }
+    } else if (outputKind == OutputKind::IR && outputPath.empty()) {
+        codegen.printModule();
+    } else {
+        try {
+            if (outputKind == OutputKind::IR) {
+                Emitter::writeIR(*codegen.getModule(), outputPath);
+            } else {
+                Emitter emitter(optLevel);
+                if (outputKind == OutputKind::Executable)
+                    emitter.emitExecutable(*codegen.getModule(), outputPath);
+                else
+                    emitter.emitFile(*codegen.getModule(), outputKind, outputPath);
+            }
+        } catch (const std::runtime_error &e) {
+            Logger::getInstance().flush();
+            errors << "Emission error: " << e.what() << "\n";
+            return std::nullopt;
+        }
     }
 
-    // Output of the generated LLVM-IR
-    codegen.printModule();
-    
-    Logger::getInstance().printPerformanceSummary();
+    // With --run the program's exit status is picc's
+    return exitStatus;
+}
+
+/**
+ * @brief Compiles several files in one process, each into its default output file.
+ *
+ * The files are distributed over a pool of jobs threads; every file has its
+ * own source manager, AST and Codegen (and so its own LLVM context). A file
+ * that fails does not stop the others: its diagnostics are printed, prefixed
+ * with its path, as soon as it is done.
+ *
+ * @return 0 if all files compiled, 1 otherwise.
+ */
+static int compileBatch(const CompileOptions& options, const std::vector<std::string>& inputs, unsigned jobs) {
+    // foo/a.pi and bar/a.pi would write the same a.ll
+    std::vector<std::string> outputs;
+    std::map<std::string, std::string> producers;
+    for (const std::string& input : inputs) {
+        outputs.push_back(Emitter::defaultOutputPath(input, options.outputKind));
+        auto [producer, inserted] = producers.emplace(outputs.back(), input);
+        if (!inserted) {
+            std::cerr << "Both " << producer->second << " and " << input << " would be written to " << outputs.back() << std::endl;
+            return 1;
+        }
+    }
+
+    std::atomic<size_t> failures {0};
+    {
+        LOG_SCOPE("Batch Compilation");
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            pool.async([&, i] {
+                std::ostringstream errors;
+                std::optional<int> status;
+                {
+                    LOG_SCOPE_DETAIL("Compile File", inputs[i]);
+                    status = compileFile(options, inputs[i], outputs[i], 1, errors);
+                }
+                if (!status) {
+                    failures++;
+
+                    // One record of the logger, so neither log lines nor other files end up inside it
+                    Logger::getInstance().output(inputs[i] + ": " + errors.str());
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    LOG_INFO("Batch: compiled " + std::to_string(inputs.size() - failures) + " of " + std::to_string(inputs.size()) + " files");
+    if (failures > 0) {
+        Logger::getInstance().flush();
+        std::cerr << failures << " of " << inputs.size() << " files failed" << std::endl;
+        return 1;
+    }
     return 0;
+}
+
+/// @brief One compile: the whole pipeline for the command line (also run by the compile server per request)
+static int compile(int argc, char **argv) {
+
+    LOG_INFO("PICC starting");
+
+    // @file arguments are replaced by the (GNU-style quoted) arguments in the file
+    llvm::BumpPtrAllocator allocator;
+    llvm::StringSaver saver(allocator);
+    llvm::SmallVector<const char*, 16> args(argv, argv + argc);
+    if (!llvm::cl::ExpandResponseFiles(saver, llvm::cl::TokenizeGNUCommandLine, args)) {
+        std::cerr << "Cannot read a response file (missing, recursive or nested too deeply)" << std::endl;
+        return 1;
+    }
+
+    // Command line: options may appear anywhere, at least one input is required
+    std::vector<std::string> inputs;
+    std::string timeTracePath;
+    uint64_t timeTraceGranularityUs = 0;
+    unsigned jobs = 1;
+    CompileOptions options;
+    std::string outputPath;
+    bool showCacheStats = false;
+
+    for (size_t i = 1; i < args.size(); ++i) {
+        std::string arg = args[i];
+
+        if (arg == "--time-trace") {
+            timeTracePath = "picc-time-trace.json";
+        } else if (arg.rfind("--time-trace=", 0) == 0) {
+            timeTracePath = arg.substr(std::string("--time-trace=").size());
+        } else if (arg.rfind("--time-trace-granularity=", 0) == 0) {
+            try {
+                timeTraceGranularityUs = std::stoull(arg.substr(std::string("--time-trace-granularity=").size()));
+            } catch (const std::exception&) {
+                std::cerr << "Invalid value in " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg == "-O0" || arg == "-O1" || arg == "-O2" || arg == "-O3") {
+            options.optLevel = static_cast<OptLevel>(arg[2] - '0');
+        } else if (arg == "-O") {
+            options.optLevel = OptLevel::O2;
+        } else if (arg == "-c") {
+            options.outputKind = OutputKind::Object;
+        } else if (arg == "-S") {
+            options.outputKind = OutputKind::Assembly;
+        } else if (arg == "-o") {
+            if (i + 1 >= args.size()) {
+                std::cerr << "Missing file name after -o" << std::endl;
+                return 1;
+            }
+            outputPath = args[++i];
+        } else if (arg == "--cache") {
+            options.useCache = true;
+        } else if (arg == "--incremental") {
+            options.incremental = true;
+        } else if (arg == "--cache-stats") {
+            showCacheStats = true;
+        } else if (arg == "--no-bounds-checks") {
+            options.boundsChecks = false;
+        } else if (arg == "--run") {
+            options.runProgram = true;
+        } else if (arg == "--time-passes") {
+            options.timePasses = true;
+        } else if (arg.rfind("-j", 0) == 0) {
+            // -j N or -jN: number of threads (0 = all cores)
+            std::string value = arg.size() > 2 ? arg.substr(2) : (i + 1 < args.size() ? args[++i] : "");
+            try {
+                jobs = static_cast<unsigned>(std::stoul(value));
+            } catch (const std::exception&) {
+                std::cerr << "Invalid value for -j: " << value << std::endl;
+                return 1;
+            }
+            if (jobs == 0)
+                jobs = std::max(1u, std::thread::hardware_concurrency());
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+
+    if (showCacheStats) {
+        CompileCache cache(CompileCache::defaultDirectory(), CompileCache::defaultMaxBytes());
+        CompileCache functionStore(CompileCache::functionStoreDirectory(), CompileCache::defaultMaxBytes());
+        std::cout << cache.formatStats() << "\n" << functionStore.formatStats();
+        if (inputs.empty())
+            return 0;
+    }
+
+    if (inputs.empty()) {
+        LOG_ERROR("Insufficient command line arguments");
+        std::cerr << "Usage: " << argv[0] << " [--run | -c | -S] [-o <file>] [--cache] [--incremental] [--cache-stats] [--no-bounds-checks] [--server | --client] [--socket=<path>] [-O0|-O1|-O2|-O3] [-j N] [--time-passes] [--time-trace[=<file.json>]] [--time-trace-granularity=<us>] <pi_file_path | - | @response_file>..." << std::endl;
+        return 1;
+    }
+
+    if (options.runProgram && (options.outputKind != OutputKind::IR || !outputPath.empty())) {
+        std::cerr << "--run cannot be combined with -c, -S or -o" << std::endl;
+        return 1;
+    }
+
+    // Several inputs each get their own output file, so there is nothing to name or to run
+    bool batch = inputs.size() > 1;
+    if (batch && (options.runProgram || !outputPath.empty())) {
+        std::cerr << "--run and -o need a single input file" << std::endl;
+        return 1;
+    }
+    if (batch && std::find(inputs.begin(), inputs.end(), "-") != inputs.end()) {
+        std::cerr << "stdin (-) cannot be compiled together with other files" << std::endl;
+        return 1;
+    }
+
+    // -o alone links an executable; -c / -S without -o derive the name from the input
+    if (!outputPath.empty() && options.outputKind == OutputKind::IR)
+        options.outputKind = OutputKind::Executable;
+    if (outputPath.empty() && options.outputKind != OutputKind::IR)
+        outputPath = Emitter::defaultOutputPath(inputs.front(), options.outputKind);
+
+    if (!timeTracePath.empty())
+        Profiler::getInstance().enableTracing(timeTraceGranularityUs * 1000);
+
+    if ((options.useCache || options.incremental) && !options.runProgram)
+        options.compiler = CompileCache::compilerIdentity(argv[0]);
+
+    // A batch spends its threads on files, a single file on its functions
+    int exitStatus;
+    if (batch) {
+        exitStatus = compileBatch(options, inputs, jobs);
+    } else {
+        std::optional<int> status = compileFile(options, inputs.front(), outputPath, jobs, std::cerr);
+        if (!status)
+            return 1;
+        exitStatus = *status;
+    }
+
+    if (!finishProfiling(timeTracePath))
+        return 1;
+
+    return exitStatus;
     
-}
\ No newline at end of file
+}
+
+// The Pi file is given by the arguments
+int main(int argc, char **argv) {
+
+    // --server and --client are decided before anything else is set up: a
+    // client forwards its command line and never touches LLVM
+    std::string socketPath;
+    bool server = false;
+    bool client = false;
+    std::vector<char*> args { argv[0] };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--server")
+            server = true;
+        else if (arg == "--client")
+            client = true;
+        else if (arg.rfind("--socket=", 0) == 0)
+            socketPath = arg.substr(std::string("--socket=").size());
+        else
+            args.push_back(argv[i]);
+    }
+    if (socketPath.empty())
+        socketPath = CompileServer::defaultSocketPath();
+
+    if (server) {
+        try {
+            Codegen::initializeTargets();
+            CompileServer compileServer(socketPath);
+            return compileServer.serve([] (int requestArgc, char** requestArgv) {
+                configureLogging();
+                return compile(requestArgc, requestArgv);
+            }, argv[0]);
+        } catch (const std::runtime_error &e) {
+            std::cerr << "Compile server error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Without a server the client compiles by itself
+    if (client) {
+        try {
+            std::optional<int> status = CompileServer::request(socketPath, std::vector<std::string>(args.begin() + 1, args.end()));
+
+            // Nothing to clean up: skipping LLVM's static destructors saves a good part of a client's run time
+            if (status)
+                _exit(*status);
+        } catch (const std::runtime_error &e) {
+            std::cerr << "Compile server error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    configureLogging();
+    args.push_back(nullptr);
+    return compile(static_cast<int>(args.size() - 1), args.data());
+}
@@ -1,10 +1,16 @@
 import os
+import shutil
+import signal
 import sys
 import subprocess
+import tempfile
+import time
 
 # --- Configuration ---
 # Path to your compiler binary (adjust if your build folder is different)
 COMPILER_BIN = "./build/picc"
+# The compile server client, built next to the compiler
+CLIENT_BIN = os.path.join(os.path.dirname(COMPILER_BIN), "picc-client")
 # Directory containing your .pi test files
 TEST_DIR = "tests"
 
@@ -21,14 +27,23 @@ class Colors:
 def run_test(file_path):
     """
     Runs a single test file.
-    1. Parses expected output from // CHECK: comments.
-    2. Runs the compiler.
-    3. Verifies that expected output exists in actual output.
+    1. Parses expected output from // CHECK: comments
+       (and extra compiler options from a // FLAGS: line).
+    2. Runs the compiler, or with a // SERVER line a compile server and
+       picc-client (and the command of a // RUN: line).
+    3. Verifies that expected output exists in actual output and in the
+       files of // CHECK_FILE: lines, and the exit status of an // EXIT: line
+       (or, for a negative test, every // EXPECT_FAIL: message in stderr).
     """
     
     # 1. Parse expectations
     expected_checks = []
-    expect_fail_msg = None
+    expect_fail_msgs = []
+    file_checks = []
+    flags = []
+    run_command = []
+    expected_exit = None
+    use_server = False
     
     try:
         with open(file_path, 'r') as f:
@@ -38,41 +53,91 @@ def run_test(file_path):
                     check_content = line.split("// CHECK:")[1].strip()
                     if check_content:
                         expected_checks.append(check_content)
+                elif "// CHECK_FILE:" in line:
+                    # "<file> <text>": the text must appear in the output file
+                    path, check_content = line.split("// CHECK_FILE:")[1].strip().split(None, 1)
+                    file_checks.append((path, check_content))
+                elif "// RUN:" in line:
+                    run_command = line.split("// RUN:")[1].split()
+                elif "// SERVER" in line:
+                    use_server = True
+                elif "// EXIT:" in line:
+                    expected_exit = int(line.split("// EXIT:")[1])
+                elif "// FLAGS:" in line:
+                    flags = line.split("// FLAGS:")[1].split()
                 elif "// EXPECT_FAIL:" in line:
-                    expect_fail_msg = line.split("// EXPECT_FAIL:")[1].strip()
+                    expect_fail_msgs.append(line.split("// EXPECT_FAIL:")[1].strip())
                     
     except Exception as e:
         print(f"{Colors.FAIL}Error reading file {file_path}: {e}{Colors.ENDC}")
         return False
 
     # If no checks are defined and not expecting fail, skip the test (or mark as passed)
-    if not expected_checks and not expect_fail_msg:
-        print(f"{Colors.WARNING}⚠️  SKIPPED: {file_path} (No CHECK or EXPECT_FAIL lines found){Colors.ENDC}")
+    if not expected_checks and not expect_fail_msgs and not file_checks and expected_exit is None:
+        print(f"{Colors.WARNING}⚠️  SKIPPED: {file_path} (No CHECK, CHECK_FILE, EXIT or EXPECT_FAIL lines found){Colors.ENDC}")
         return True
 
     # 2. Run the compiler
+    # Each test runs in a scratch directory, so output files of batch compiles and
+    # logs land there and --cache / --incremental start from an empty store. The
+    # test directory is linked into it, so paths in FLAGS and response files
+    # stay relative to the repository root.
     try:
-        # We capture stdout (IR code) and stderr (Logs)
-        result = subprocess.run(
-            [COMPILER_BIN, file_path],
-            capture_output=True,
-            text=True
-        )
+        with tempfile.TemporaryDirectory() as scratch:
+            os.symlink(os.path.abspath(TEST_DIR), os.path.join(scratch, TEST_DIR))
+            env = dict(os.environ, PICC_CACHE_DIR=os.path.join(scratch, "cache"))
+
+            command = [os.path.abspath(COMPILER_BIN)]
+            server = None
+            if use_server:
+                server, command, env = start_server(scratch, env)
+                if server is None:
+                    print(f"{Colors.FAIL}❌ FAILED: {file_path} (Compile server did not start){Colors.ENDC}")
+                    return False
+
+            # We capture stdout (IR code) and stderr (Logs)
+            try:
+                result = subprocess.run(
+                    [*command, *flags, file_path],
+                    capture_output=True,
+                    text=True,
+                    cwd=scratch,
+                    env=env
+                )
+            finally:
+                if server is not None:
+                    server.send_signal(signal.SIGTERM)
+                    server.wait()
+            # The exit status of an EXIT line is picc's (with --run, the program's),
+            # or that of the RUN command, which runs after a successful compile
+            compiled = result
+            if run_command and result.returncode == 0:
+                result = subprocess.run(run_command, capture_output=True, text=True, cwd=scratch, env=env)
+
+            file_contents = {}
+            for path, _ in file_checks:
+                try:
+                    with open(os.path.join(scratch, path), 'r') as f:
+                        file_contents[path] = f.read()
+                except OSError:
+                    file_contents[path] = None
     except FileNotFoundError:
         print(f"{Colors.FAIL}❌ CRITICAL: Compiler not found at '{COMPILER_BIN}'{Colors.ENDC}")
         sys.exit(1)
 
     # --- Negative Test Handling ---
-    if expect_fail_msg:
-        if result.returncode == 0:
+    if expect_fail_msgs:
+        if compiled.returncode == 0:
             print(f"{Colors.FAIL}❌ FAILED: {file_path}{Colors.ENDC}")
             print(f"{Colors.BOLD}   Expected failure but compiler exited successfully.{Colors.ENDC}")
             return False
         
-        if expect_fail_msg not in result.stderr:
+        missing = [msg for msg in expect_fail_msgs if msg not in compiled.stderr]
+        if missing:
             print(f"{Colors.FAIL}❌ FAILED: {file_path}{Colors.ENDC}")
             print(f"{Colors.BOLD}   Expected error message not found in stderr:{Colors.ENDC}")
-            print(f"     Expected: '{expect_fail_msg}'")
+            for msg in missing:
+                print(f"     Expected: '{msg}'")
             # print(f"     Actual Stderr:\n{result.stderr}")
             return False
             
@@ -82,19 +147,29 @@ def run_test(file_path):
     # --- Positive Test Handling ---
     
     # Check if compiler crashed (non-zero exit code)
-    if result.returncode != 0:
-        print(f"{Colors.FAIL}❌ FAILED: {file_path} (Compiler returned exit code {result.returncode}){Colors.ENDC}")
-        print(f"{Colors.BOLD}Stderr output:{Colors.ENDC}\n{result.stderr}")
+    if compiled.returncode != 0 and (run_command or expected_exit is None):
+        print(f"{Colors.FAIL}❌ FAILED: {file_path} (Compiler returned exit code {compiled.returncode}){Colors.ENDC}")
+        print(f"{Colors.BOLD}Stderr output:{Colors.ENDC}\n{compiled.stderr}")
+        return False
+
+    if expected_exit is not None and result.returncode != expected_exit:
+        print(f"{Colors.FAIL}❌ FAILED: {file_path} (Exit code {result.returncode}, expected {expected_exit}){Colors.ENDC}")
         return False
 
     # 3. Verify Output
-    actual_output = result.stdout
+    actual_output = compiled.stdout
     failed_checks = []
 
     for check in expected_checks:
         if check not in actual_output:
             failed_checks.append(check)
 
+    for path, check in file_checks:
+        if file_contents[path] is None:
+            failed_checks.append(f"{path} (not written)")
+        elif check not in file_contents[path]:
+            failed_checks.append(f"{path}: {check}")
+
     if failed_checks:
         print(f"{Colors.FAIL}❌ FAILED: {file_path}{Colors.ENDC}")
         print(f"{Colors.BOLD}   Expected but not found in output:{Colors.ENDC}")
@@ -108,6 +183,33 @@ def run_test(file_path):
     print(f"{Colors.OKGREEN}✅ PASSED: {file_path}{Colors.ENDC}")
     return True
 
+def start_server(scratch, env):
+    """
+    Starts picc --server on a socket in the scratch directory and returns it
+    with the client command line and environment. The client is copied into
+    the scratch directory and picc is kept off its PATH, so a request that
+    does not reach the server fails instead of being compiled by the client.
+    """
+    socket_path = os.path.join(scratch, "picc.sock")
+    server = subprocess.Popen(
+        [os.path.abspath(COMPILER_BIN), "--server", f"--socket={socket_path}"],
+        stdout=subprocess.DEVNULL,
+        stderr=subprocess.DEVNULL,
+        cwd=scratch,
+        env=env
+    )
+    deadline = time.monotonic() + 10
+    while not os.path.exists(socket_path):
+        if server.poll() is not None or time.monotonic() > deadline:
+            server.kill()
+            server.wait()
+            return None, None, env
+        time.sleep(0.01)
+
+    client = shutil.copy(CLIENT_BIN, os.path.join(scratch, "picc-client"))
+    path = [d for d in env.get("PATH", "").split(os.pathsep) if not os.path.exists(os.path.join(d, "picc"))]
+    return server, [client, f"--socket={socket_path}"], dict(env, PATH=os.pathsep.join(path))
+
 def main():
     if not os.path.exists(TEST_DIR):
         print(f"{Colors.FAIL}Error: Test directory '{TEST_DIR}' not found.{Colors.ENDC}")